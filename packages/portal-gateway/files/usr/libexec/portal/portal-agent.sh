@@ -33,8 +33,11 @@ JWT_TOKEN=""
 JWT_EXPIRES_AT=0
 
 # signer service (C portal-signer)
-PORTAL_SIGNER_URL="http://127.0.0.1:9000/sign"
+PORTAL_SIGNER_URL="${PORTAL_SIGNER_URL:-http://127.0.0.1:9000/sign}"
 PORTAL_SIGNER_KID="v1"
+# signer grant API (POST /access, signed with its own key; see --access)
+PORTAL_ACCESS_URL="${PORTAL_ACCESS_URL:-http://127.0.0.1:9000/access}"
+PORTAL_ACCESS_KEY_FILE="${PORTAL_ACCESS_KEY_FILE:-/etc/portal/portal.access.key}"
 
 
 # Runtime endpoint (Go controller). We keep a fallback to legacy paths.
@@ -61,6 +64,16 @@ PORTAL_FW="${PORTAL_FW:-/usr/libexec/portal/portal-fw.sh}"
 NGINX_PORTAL_DIR="${NGINX_PORTAL_DIR:-/etc/nginx/conf.d/portal}"
 NGINX_CLIENT_MAP_FILE="${NGINX_CLIENT_MAP_FILE:-${NGINX_PORTAL_DIR}/portal-client-maps.conf}"
 NGINX_RELOAD="${NGINX_RELOAD:-1}"
+# Compiled map generator (one netlink pass, rewrites/reloads only on change);
+# the shell pipelines below are kept as fallback when it is missing or fails
+CTXMAP_BIN="${CTXMAP_BIN:-/usr/libexec/portal/portal-ctxmap}"
+# map_hash_* sized by portal-ctxmap; must sort before portal-auth.conf (map blocks)
+NGINX_MAP_HASH_FILE="${NGINX_MAP_HASH_FILE:-${NGINX_PORTAL_DIR}/portal-00-map-hash.conf}"
+# Client context source:
+# - maps   : generate per-client nginx maps from ip neigh / iw (polling + reload)
+# - signer : portal-signer tracks clients via netlink (ctx.enable=1);
+#            only a default-only map file is kept so nginx variables exist
+CLIENT_CTX_SOURCE="${CLIENT_CTX_SOURCE:-maps}"
 
 # VLAN discovery:
 BRIDGE_NAME="${BRIDGE_NAME:-br-lan}"
@@ -107,13 +120,53 @@ if [ "${1:-}" = "--check" ]; then
   fi
 fi
 
+# ---------------------------------------------------------
+# Grant / revoke mode: portal-agent --access grant <mac> [guest|staff] [ttl]
+#                      portal-agent --access revoke <mac>
+# Posts one operation to the signer's /access (ipset.enable=1), signed
+# v1 over "POST /access" + body with PORTAL_ACCESS_KEY_FILE.
+# ---------------------------------------------------------
+if [ "${1:-}" = "--access" ]; then
+  shift
+  case "${1:-}:${2:-}" in
+    grant:?*|revoke:?*) ;;
+    *)
+      echo "usage: portal-agent --access grant <mac> [guest|staff] [ttl] | revoke <mac>" >&2
+      exit 2
+      ;;
+  esac
+
+  body="$*"
+  ts="$(date +%s)"
+  nonce="$(cat /proc/sys/kernel/random/uuid 2>/dev/null || uuidgen)"
+  body_hash="$(printf '%s\n' "$body" | sha256sum | awk '{print $1}')"
+  key="$(cat "$PORTAL_ACCESS_KEY_FILE")" || exit 2
+  sign="$(printf '%s\n%s\nPOST\n/access\n\n%s\n' "$ts" "$nonce" "$body_hash" \
+    | openssl dgst -sha256 -hmac "$key" -binary \
+    | base64)"
+
+  log "event=access_post op='${1}' mac='${2}' url='${PORTAL_ACCESS_URL}'"
+
+  if printf '%s\n' "$body" | curl -fsS --max-time 5 \
+      -H "X-Portal-Kid: v1" \
+      -H "X-Portal-Timestamp: ${ts}" \
+      -H "X-Portal-Nonce: ${nonce}" \
+      -H "X-Portal-Signature: ${sign}" \
+      --data-binary @- "$PORTAL_ACCESS_URL"; then
+    echo
+    exit 0
+  fi
+  log "level=error event=access_post_failed op='${1}' mac='${2}'"
+  exit 1
+fi
+
 # 业务分组初始化打印（每组一行）
 log "event=init_ctrl ctrl_host='${CTRL_HOST}' ctrl_port='${CTRL_PORT}' ctrl_base='${CTRL_BASE}' runtime_path='${RUNTIME_PATH}' runtime_legacy_path='${RUNTIME_LEGACY_PATH}'"
 log "event=init_identity ap_id='${AP_ID}' site_id='${SITE_ID}'"
 log "event=init_radio radio_ids_env='${RADIO_IDS}'"
 log "event=init_runtime runtime_env='${RUNTIME_ENV}'"
 log "event=init_fw apply_fw='${APPLY_FW}' portal_fw='${PORTAL_FW}'"
-log "event=init_nginx portal_dir='${NGINX_PORTAL_DIR}' client_map_file='${NGINX_CLIENT_MAP_FILE}' nginx_reload='${NGINX_RELOAD}'"
+log "event=init_nginx portal_dir='${NGINX_PORTAL_DIR}' client_map_file='${NGINX_CLIENT_MAP_FILE}' nginx_reload='${NGINX_RELOAD}' client_ctx_source='${CLIENT_CTX_SOURCE}'"
 log "event=init_vlan bridge_name='${BRIDGE_NAME}' trust_vlans='${TRUST_VLANS}' captive_vlans='${CAPTIVE_VLANS}' captive_ifs_explicit='${CAPTIVE_IFS}'"
 log "event=init_conf conf_file='${CONF_FILE}'"
 
@@ -225,6 +278,69 @@ EOF
     [ -n "$SIGN_TS" ] && [ -n "$SIGN_NONCE" ] && [ -n "$SIGN_SIG" ]
 }
 
+# Same as portal_sign_request, for a body stored in a file of any size
+# (captures, diagnostics bundles): the signer hashes it as it streams in.
+portal_sign_file() {
+    local method="$1"
+    local path="$2"
+    local raw_query="$3"
+    local file="$4"
+
+    local resp
+    resp="$(curl -fsS \
+        -X POST "${PORTAL_SIGNER_URL}/raw" \
+        -H "X-Sign-Method: $method" \
+        -H "X-Sign-Path: $path" \
+        -H "X-Sign-Query: $raw_query" \
+        -H "Content-Type: application/octet-stream" \
+        -T "$file")" || return 1
+
+    SIGN_KID="$(echo "$resp" | jsonfilter -e '@.kid')"
+    SIGN_TS="$(echo "$resp" | jsonfilter -e '@.timestamp')"
+    SIGN_NONCE="$(echo "$resp" | jsonfilter -e '@.nonce')"
+    SIGN_SIG="$(echo "$resp" | jsonfilter -e '@.signature')"
+
+    [ -n "$SIGN_TS" ] && [ -n "$SIGN_NONCE" ] && [ -n "$SIGN_SIG" ]
+}
+
+# POST a file to the controller (CTRL_BASE + path), v1-signed by the signer
+portal_push_file() {
+    local path="$1"
+    local file="$2"
+
+    portal_sign_file POST "$path" "" "$file" || return 1
+
+    curl -fsS \
+        -X POST "${CTRL_BASE}${path}" \
+        -H "X-Portal-Kid: ${SIGN_KID:-$PORTAL_SIGNER_KID}" \
+        -H "X-Portal-Timestamp: ${SIGN_TS}" \
+        -H "X-Portal-Nonce: ${SIGN_NONCE}" \
+        -H "X-Portal-Signature: ${SIGN_SIG}" \
+        -H "X-Portal-AP-ID: ${AP_ID}" \
+        -H "Content-Type: application/octet-stream" \
+        -T "$file"
+}
+
+# ---------------------------------------------------------
+# Push mode: portal-agent --push <controller-path> <file>
+# e.g. portal-agent --push /api/v1/ap/captures /tmp/portal-signer.cap
+# ---------------------------------------------------------
+if [ "${1:-}" = "--push" ]; then
+  if [ -z "${2:-}" ] || [ ! -f "${3:-}" ]; then
+    echo "usage: portal-agent --push <controller-path> <file>" >&2
+    exit 2
+  fi
+
+  log "event=push path='${2}' file='${3}' size=$(wc -c <"$3")"
+  if portal_push_file "$2" "$3" >/dev/null; then
+    log "event=push_ok path='${2}'"
+    exit 0
+  fi
+  log "level=error event=push_failed path='${2}' file='${3}'"
+  echo "portal-agent: push of ${3} to ${2} failed" >&2
+  exit 1
+fi
+
 
 # ---------------------------------------------------------
 # Radio discovery
@@ -596,6 +712,41 @@ generate_nginx_maps() {
   mv -f "$tmp" "$NGINX_CLIENT_MAP_FILE"
 }
 
+# Default-only maps for CLIENT_CTX_SOURCE=signer.
+# Content is static, so nginx only needs a reload when it first appears.
+generate_nginx_stub_maps() {
+  [ -f "$NGINX_CLIENT_MAP_FILE" ] && grep -q "client_ctx_source=signer" "$NGINX_CLIENT_MAP_FILE" && return 1
+
+  tmp="${NGINX_CLIENT_MAP_FILE}.tmp.$$"
+  umask 077
+  {
+    echo "# Auto-generated by portal-agent.sh (client_ctx_source=signer)"
+    echo "# Client context is resolved live by portal-signer; defaults only"
+    echo ""
+    echo "map \$remote_addr \$portal_mac { default \"\"; }"
+    echo "map \$remote_addr \$portal_vlan_id { default 0; }"
+    echo "map \$remote_addr \$portal_radio_id { default \"\"; }"
+    echo "map \$remote_addr \$portal_ssid { default \"\"; }"
+    echo ""
+    echo "map \"\" \$portal_ap_id {"
+    echo "    default \"$(escape_nginx_str "$AP_ID")\";"
+    echo "}"
+  } >"$tmp"
+
+  mv -f "$tmp" "$NGINX_CLIENT_MAP_FILE"
+  return 0
+}
+
+# Returns 0 if the maps changed, 1 if unchanged, 2 if the helper failed.
+generate_nginx_maps_native() {
+  [ -x "$CTXMAP_BIN" ] || return 2
+  rc=0
+  "$CTXMAP_BIN" -o "$NGINX_CLIENT_MAP_FILE" -s "$NGINX_MAP_HASH_FILE" \
+    -a "$AP_ID" -i "$CAPTIVE_IFS_RESOLVED" -w "$RADIOS" 2>/dev/null || rc=$?
+  [ "$rc" -le 2 ] || rc=2
+  return $rc
+}
+
 maybe_reload_nginx() {
   [ "$NGINX_RELOAD" = "1" ] || return 0
   if command -v nginx >/dev/null 2>&1; then
@@ -609,8 +760,25 @@ maybe_reload_nginx() {
 
 # Ensure portal dir exists before writing map
 if [ -d "$NGINX_PORTAL_DIR" ]; then
-  generate_nginx_maps || true
-  maybe_reload_nginx || true
+  if [ "$CLIENT_CTX_SOURCE" = "signer" ]; then
+    if generate_nginx_stub_maps; then
+      maybe_reload_nginx || true
+    else
+      log "event=nginx_maps_unchanged source=signer skip_reload=1"
+    fi
+  else
+    rc=0
+    generate_nginx_maps_native || rc=$?
+    case "$rc" in
+      0) maybe_reload_nginx || true ;;
+      1) log "event=nginx_maps_unchanged source=maps skip_reload=1" ;;
+      *)
+        log "level=warn event=nginx_ctxmap_unavailable bin=${CTXMAP_BIN} fallback=shell"
+        generate_nginx_maps || true
+        maybe_reload_nginx || true
+        ;;
+    esac
+  fi
 else
   log "level=warn event=nginx_portal_dir_missing path=${NGINX_PORTAL_DIR} skip_nginx_maps=1"
 fi
@@ -133,7 +133,8 @@ ensure_jump() {
 ensure_ipset() {
   name="$1"
   type="$2"
-  ipset list "$name" >/dev/null 2>&1 || ipset create "$name" "$type" -exist
+  shift 2
+  ipset list "$name" >/dev/null 2>&1 || ipset create "$name" "$type" "$@" -exist
 }
 
 # ---------------------------------------------------------
@@ -147,8 +148,9 @@ apply_rules() {
   ensure_ipset "$IPSET_BYPASS_IP" "hash:ip"
   ensure_ipset "$IPSET_BYPASS_DNS" "hash:ip"
   # controller role ipsets may be created elsewhere; ensure them to be safe
-  ensure_ipset "$IPSET_GUEST" "hash:mac"
-  ensure_ipset "$IPSET_STAFF" "hash:mac"
+  # "timeout 0": per-entry lifetimes from portal-signer (ipset.*), default permanent
+  ensure_ipset "$IPSET_GUEST" "hash:mac" timeout 0
+  ensure_ipset "$IPSET_STAFF" "hash:mac" timeout 0
 
   # chains
   ensure_chain nat "$CHAIN_NAT"
@@ -0,0 +1,539 @@
+#include "bypass.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BYPASS_LABEL_MAX 63
+#define BYPASS_HOST_MAX  253
+#define BYPASS_ITEM_MAX  1024
+
+/* Trie node: one host label below its parent; node 0 is the root */
+typedef struct {
+    uint32_t parent;
+    uint32_t label;         /* offset into pool */
+    uint8_t  len;
+    uint8_t  all;           /* entry without a path: every URI matches */
+    uint16_t npaths;
+    uint32_t paths;         /* first entry in path[] */
+} bp_node_t;
+
+typedef struct {
+    uint32_t node;
+    uint32_t off;           /* path prefix in pool */
+    uint32_t len;
+} bp_path_t;
+
+/* Inclusive range, 16-byte big endian; IPv4 as ::ffff:a.b.c.d */
+typedef struct {
+    uint8_t lo[16];
+    uint8_t hi[16];
+} bp_range_t;
+
+typedef struct {
+    bp_node_t  *node;   uint32_t nnodes,  cap_nodes;
+    uint32_t   *index;  uint32_t mask;      /* (parent, label) -> node id, 0 = empty */
+    char       *pool;   uint32_t npool,   cap_pool;
+    bp_path_t  *path;   uint32_t npaths,  cap_paths;
+    bp_range_t *range;  uint32_t nranges, cap_ranges;
+    uint32_t    ndomains;
+    int         off;    /* BYPASS_ENABLED=false */
+    int         oom;
+} bp_table_t;
+
+static bp_table_t *g_cur;
+static time_t      g_checked;
+static int         g_have_st;
+static struct stat g_st;
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static int grow(void **p, uint32_t *cap, uint32_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    uint32_t n = *cap ? *cap : 64;
+    while (n < need) n <<= 1;
+    void *q = realloc(*p, (size_t)n * elem);
+    if (!q) return -1;
+    *p = q;
+    *cap = n;
+    return 0;
+}
+
+static uint32_t label_hash(uint32_t parent, const char *s, size_t len) {
+    uint32_t h = 2166136261u ^ (parent * 0x9e3779b1u);
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+static uint32_t find_child(const bp_table_t *t, uint32_t parent, const char *s, size_t len) {
+    uint32_t i = label_hash(parent, s, len) & t->mask;
+    for (uint32_t id; (id = t->index[i]) != 0; i = (i + 1) & t->mask) {
+        const bp_node_t *n = &t->node[id];
+        if (n->parent == parent && n->len == len && !memcmp(t->pool + n->label, s, len))
+            return id;
+    }
+    return 0;
+}
+
+/* Keep the index at most half full */
+static int index_grow(bp_table_t *t) {
+    if (t->index && (uint64_t)(t->nnodes + 1) * 2 <= (uint64_t)t->mask + 1)
+        return 0;
+
+    uint32_t slots = t->index ? (t->mask + 1) * 2 : 256;
+    uint32_t *idx = (uint32_t *)calloc(slots, sizeof(*idx));
+    if (!idx) return -1;
+    for (uint32_t id = 1; id < t->nnodes; id++) {
+        const bp_node_t *n = &t->node[id];
+        uint32_t i = label_hash(n->parent, t->pool + n->label, n->len) & (slots - 1);
+        while (idx[i]) i = (i + 1) & (slots - 1);
+        idx[i] = id;
+    }
+    free(t->index);
+    t->index = idx;
+    t->mask = slots - 1;
+    return 0;
+}
+
+static int pool_add(bp_table_t *t, const char *s, size_t len, uint32_t *off) {
+    if (grow((void **)&t->pool, &t->cap_pool, t->npool + (uint32_t)len, 1) != 0)
+        return -1;
+    memcpy(t->pool + t->npool, s, len);
+    *off = t->npool;
+    t->npool += (uint32_t)len;
+    return 0;
+}
+
+static uint32_t add_child(bp_table_t *t, uint32_t parent, const char *s, size_t len) {
+    uint32_t id = find_child(t, parent, s, len);
+    if (id) return id;
+
+    uint32_t off;
+    if (index_grow(t) != 0 ||
+        grow((void **)&t->node, &t->cap_nodes, t->nnodes + 1, sizeof(bp_node_t)) != 0 ||
+        pool_add(t, s, len, &off) != 0) {
+        t->oom = 1;
+        return 0;
+    }
+
+    id = t->nnodes++;
+    bp_node_t *n = &t->node[id];
+    memset(n, 0, sizeof(*n));
+    n->parent = parent;
+    n->label = off;
+    n->len = (uint8_t)len;
+
+    uint32_t i = label_hash(parent, s, len) & t->mask;
+    while (t->index[i]) i = (i + 1) & t->mask;
+    t->index[i] = id;
+    return id;
+}
+
+/* Lowercase `host` into `out`, dropping a port, [] around IPv6 and a trailing dot. */
+static size_t norm_host(const char *host, size_t len, char out[BYPASS_HOST_MAX + 1]) {
+    if (len && host[0] == '[') {
+        const char *rb = memchr(host, ']', len);
+        if (!rb) return 0;
+        host++;
+        len = (size_t)(rb - host);
+    } else {
+        const char *c = memchr(host, ':', len);
+        if (c && !memchr(c + 1, ':', len - (size_t)(c + 1 - host)))
+            len = (size_t)(c - host);       /* one colon: host:port */
+    }
+    while (len && host[len - 1] == '.') len--;
+    if (len == 0 || len > BYPASS_HOST_MAX) return 0;
+
+    for (size_t i = 0; i < len; i++)
+        out[i] = (char)tolower((unsigned char)host[i]);
+    out[len] = '\0';
+    return len;
+}
+
+/* IPv4 / IPv6 literal -> 16 bytes. Returns 4, 6 or 0. */
+static int parse_addr(const char *s, uint8_t a[16]) {
+    struct in_addr v4;
+    if (inet_pton(AF_INET, s, &v4) == 1) {
+        memset(a, 0, 10);
+        a[10] = a[11] = 0xff;
+        memcpy(a + 12, &v4, 4);
+        return 4;
+    }
+    return inet_pton(AF_INET6, s, a) == 1 ? 6 : 0;
+}
+
+static void add_prefix(bp_table_t *t, const uint8_t a[16], int bits) {
+    if (grow((void **)&t->range, &t->cap_ranges, t->nranges + 1, sizeof(bp_range_t)) != 0) {
+        t->oom = 1;
+        return;
+    }
+    bp_range_t *r = &t->range[t->nranges++];
+    for (int i = 0; i < 16; i++) {
+        int b = bits - i * 8;
+        uint8_t m = b >= 8 ? 0xff : b <= 0 ? 0 : (uint8_t)(0xff << (8 - b));
+        r->lo[i] = a[i] & m;
+        r->hi[i] = a[i] | (uint8_t)~m;
+    }
+}
+
+/* --------------------------------------------------
+ * List entries
+ * -------------------------------------------------- */
+
+/* "10.0.0.1", "10.0.0.0/8", "2001:db8::/32" */
+static void add_ip(bp_table_t *t, const char *item) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", item);
+
+    int bits = -1;
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        *slash = '\0';
+        bits = atoi(slash + 1);
+    }
+
+    uint8_t a[16];
+    int fam = parse_addr(buf, a);
+    if (!fam) return;
+    if (bits < 0)
+        bits = 128;
+    else if (fam == 4)
+        bits = bits <= 32 ? 96 + bits : -1;
+    if (bits < 0 || bits > 128) return;
+    add_prefix(t, a, bits);
+}
+
+/* "example.com", "*.example.com", ".example.com", "example.com/terms", "https://..." */
+static void add_domain(bp_table_t *t, const char *item) {
+    const char *s = strstr(item, "://");
+    if (s) item = s + 3;
+    if (item[0] == '*' && item[1] == '.') item += 2;
+    else if (item[0] == '.') item++;
+
+    const char *path = strchr(item, '/');
+    size_t hlen = path ? (size_t)(path - item) : strlen(item);
+    char host[BYPASS_HOST_MAX + 1];
+    size_t n = norm_host(item, hlen, host);
+    if (!n || strchr(host, '*')) return;
+
+    uint8_t a[16];
+    if (parse_addr(host, a)) {
+        add_prefix(t, a, 128);
+        return;
+    }
+
+    if (path && (path[1] == '\0' || path[1] == '?'))
+        path = NULL;
+    if (path) {
+        size_t plen = strcspn(path, "?#");
+        if (grow((void **)&t->path, &t->cap_paths, t->npaths + 1, sizeof(bp_path_t)) != 0) {
+            t->oom = 1;
+            return;
+        }
+        bp_path_t *p = &t->path[t->npaths];
+        if (pool_add(t, path, plen, &p->off) != 0) {
+            t->oom = 1;
+            return;
+        }
+        p->len = (uint32_t)plen;
+        p->node = 0;
+    }
+
+    /* Insert labels right to left: "www.example.com" -> com, example, www */
+    uint32_t cur = 0;
+    const char *end = host + n;
+    for (;;) {
+        const char *dot = end;
+        while (dot > host && dot[-1] != '.') dot--;
+        size_t ll = (size_t)(end - dot);
+        if (ll == 0 || ll > BYPASS_LABEL_MAX) return;
+        cur = add_child(t, cur, dot, ll);
+        if (!cur) return;
+        if (dot == host) break;
+        end = dot - 1;
+    }
+
+    if (path)
+        t->path[t->npaths++].node = cur;
+    else
+        t->node[cur].all = 1;
+    t->ndomains++;
+}
+
+/* Call `fn` for each string of a JSON array, or each word of a comma / space list */
+static void for_each_item(bp_table_t *t, const char *val,
+                          void (*fn)(bp_table_t *t, const char *item)) {
+    char item[BYPASS_ITEM_MAX];
+    size_t n = 0;
+
+    if (strchr(val, '"')) {
+        int in = 0, esc = 0;
+        for (const char *p = val; *p; p++) {
+            if (!in) {
+                if (*p == '"') { in = 1; n = 0; }
+                continue;
+            }
+            if (esc) {
+                esc = 0;
+            } else if (*p == '\\') {
+                esc = 1;                /* json-c writes "\/" */
+                continue;
+            } else if (*p == '"') {
+                in = 0;
+                if (n > 0 && n < sizeof(item)) {
+                    item[n] = '\0';
+                    fn(t, item);
+                }
+                continue;
+            }
+            if (n < sizeof(item) - 1) item[n++] = *p;
+            else n = sizeof(item);      /* too long, skipped */
+        }
+        return;
+    }
+
+    static const char sep[] = ", \t[]";
+    for (const char *p = val + strspn(val, sep); *p; p += strspn(p, sep)) {
+        n = strcspn(p, sep);
+        if (n < sizeof(item)) {
+            memcpy(item, p, n);
+            item[n] = '\0';
+            fn(t, item);
+        }
+        p += n;
+    }
+}
+
+/*
+ * export BYPASS_DOMAINS='["a.com","b.com"]'. Requests for these hosts
+ * still reach nginx: portal-fw.sh only RETURNs portal_bypass_ip (dst)
+ * and portal_bypass_mac (src), and the dnsmasq-filled portal_bypass_dns
+ * set is neither RETURNed nor ACCEPTed. BYPASS_MACS is not read: those
+ * clients are never redirected, so the signer never sees them.
+ */
+static void parse_line(bp_table_t *t, char *line) {
+    char *key = line + strspn(line, " \t");
+    if (!strncmp(key, "export ", 7))
+        key += 7;
+    char *val = strchr(key, '=');
+    if (!val) return;
+    *val++ = '\0';
+
+    val[strcspn(val, "\r\n")] = '\0';
+    size_t vl = strlen(val);
+    if (vl >= 2 && (val[0] == '\'' || val[0] == '"') && val[vl - 1] == val[0]) {
+        val[vl - 1] = '\0';
+        val++;
+    }
+
+    if (!strcmp(key, "BYPASS_ENABLED"))
+        t->off = !strcmp(val, "false") || !strcmp(val, "0");
+    else if (!strcmp(key, "BYPASS_DOMAINS"))
+        for_each_item(t, val, add_domain);
+    else if (!strcmp(key, "BYPASS_IPS"))
+        for_each_item(t, val, add_ip);
+}
+
+/* --------------------------------------------------
+ * Table build
+ * -------------------------------------------------- */
+static void table_free(bp_table_t *t) {
+    if (!t) return;
+    free(t->node);
+    free(t->index);
+    free(t->pool);
+    free(t->path);
+    free(t->range);
+    free(t);
+}
+
+static bp_table_t *table_new(void) {
+    bp_table_t *t = (bp_table_t *)calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    if (index_grow(t) != 0 ||
+        grow((void **)&t->node, &t->cap_nodes, 1, sizeof(bp_node_t)) != 0) {
+        table_free(t);
+        return NULL;
+    }
+    memset(&t->node[0], 0, sizeof(bp_node_t));
+    t->nnodes = 1;
+    return t;
+}
+
+static int cmp_path(const void *a, const void *b) {
+    uint32_t x = ((const bp_path_t *)a)->node, y = ((const bp_path_t *)b)->node;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_range(const void *a, const void *b) {
+    return memcmp(((const bp_range_t *)a)->lo, ((const bp_range_t *)b)->lo, 16);
+}
+
+/* Group paths per node, merge overlapping ranges */
+static void table_finish(bp_table_t *t) {
+    if (t->npaths) {
+        qsort(t->path, t->npaths, sizeof(bp_path_t), cmp_path);
+        for (uint32_t i = 0; i < t->npaths; i++) {
+            bp_node_t *n = &t->node[t->path[i].node];
+            if (!n->npaths) n->paths = i;
+            if (n->npaths < UINT16_MAX) n->npaths++;
+        }
+    }
+
+    if (t->nranges) {
+        qsort(t->range, t->nranges, sizeof(bp_range_t), cmp_range);
+        uint32_t w = 0;
+        for (uint32_t i = 1; i < t->nranges; i++) {
+            bp_range_t *cur = &t->range[w];
+            if (memcmp(t->range[i].lo, cur->hi, 16) <= 0) {
+                if (memcmp(t->range[i].hi, cur->hi, 16) > 0)
+                    memcpy(cur->hi, t->range[i].hi, 16);
+            } else {
+                t->range[++w] = t->range[i];
+            }
+        }
+        t->nranges = w + 1;
+    }
+}
+
+/* --------------------------------------------------
+ * Lookups
+ * -------------------------------------------------- */
+static int range_match(const bp_table_t *t, const uint8_t a[16]) {
+    /* last range with lo <= a */
+    uint32_t lo = 0, hi = t->nranges;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (memcmp(t->range[mid].lo, a, 16) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 && memcmp(a, t->range[lo - 1].hi, 16) <= 0;
+}
+
+static int node_allows(const bp_table_t *t, const bp_node_t *n, const char *uri) {
+    if (n->all) return 1;
+    for (uint32_t i = 0; i < n->npaths; i++) {
+        const bp_path_t *p = &t->path[n->paths + i];
+        if (!strncmp(uri, t->pool + p->off, p->len)) return 1;
+    }
+    return 0;
+}
+
+static int host_match(const bp_table_t *t, const char *host, const char *uri) {
+    char h[BYPASS_HOST_MAX + 1];
+    size_t n = norm_host(host, strlen(host), h);
+    if (!n) return 0;
+
+    uint8_t a[16];
+    if (parse_addr(h, a))
+        return range_match(t, a);
+
+    /* Walk labels right to left; any terminal on the way covers its subdomains */
+    uint32_t cur = 0;
+    const char *end = h + n;
+    for (;;) {
+        const char *dot = end;
+        while (dot > h && dot[-1] != '.') dot--;
+        cur = find_child(t, cur, dot, (size_t)(end - dot));
+        if (!cur) return 0;
+        if (node_allows(t, &t->node[cur], uri)) return 1;
+        if (dot == h) return 0;
+        end = dot - 1;
+    }
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int bypass_match(const char *host, const char *uri) {
+    const bp_table_t *t = g_cur;
+    if (!t || t->off) return 0;
+    return host && host[0] && host_match(t, host, uri ? uri : "");
+}
+
+int bypass_load(const signer_config_t *cfg) {
+    g_checked = time(NULL);
+    if (!cfg->bypass_enable) {
+        bypass_stop();
+        return 0;
+    }
+
+    struct stat st;
+    FILE *f = fopen(cfg->bypass_env, "r");
+    if (!f || fstat(fileno(f), &st) != 0) {
+        if (f) fclose(f);
+        if (g_cur)
+            fprintf(stderr, "[portal-signer] bypass: %s gone, allow-list cleared\n",
+                    cfg->bypass_env);
+        bypass_stop();
+        return 0;
+    }
+
+    bp_table_t *t = table_new();
+    if (t) {
+        char *line = NULL;
+        size_t cap = 0;
+        while (!t->oom && getline(&line, &cap, f) != -1)
+            parse_line(t, line);
+        free(line);
+    }
+    fclose(f);
+
+    if (!t || t->oom) {
+        table_free(t);
+        fprintf(stderr, "[portal-signer] bypass: allocation failed, keeping previous list\n");
+        return -1;
+    }
+    table_finish(t);
+
+    /* Swap; nothing else holds a reference outside the main loop */
+    table_free(g_cur);
+    g_cur = t;
+    g_st = st;
+    g_have_st = 1;
+
+    if (t->off)
+        fprintf(stderr, "[portal-signer] bypass: disabled by controller (%s)\n",
+                cfg->bypass_env);
+    else
+        fprintf(stderr,
+            "[portal-signer] bypass: %u domains (%u with path), %u ranges from %s\n",
+            t->ndomains, t->npaths, t->nranges, cfg->bypass_env);
+    return (int)(t->ndomains + t->nranges);
+}
+
+void bypass_tick(const signer_config_t *cfg) {
+    if (!cfg->bypass_enable) return;
+
+    time_t now = time(NULL);
+    if (now == g_checked) return;
+    g_checked = now;
+
+    /* portal-agent.sh replaces the file by rename: inode + mtime change */
+    struct stat st;
+    int have = stat(cfg->bypass_env, &st) == 0;
+    if (have == g_have_st &&
+        (!have || (st.st_ino == g_st.st_ino && st.st_size == g_st.st_size &&
+                   st.st_mtim.tv_sec == g_st.st_mtim.tv_sec &&
+                   st.st_mtim.tv_nsec == g_st.st_mtim.tv_nsec)))
+        return;
+    bypass_load(cfg);
+}
+
+void bypass_stop(void) {
+    table_free(g_cur);
+    g_cur = NULL;
+    g_have_st = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "config.h"
+
+/*
+ * Walled-garden allow-list (bypass.*), matched locally on the verify path.
+ *
+ * portal-agent.sh writes the controller's bypass lists to the runtime env
+ * file (BYPASS_DOMAINS / BYPASS_IPS, raw JSON arrays). They are compiled
+ * into:
+ *   - a reversed-label domain trie: "example.com", "*.example.com" and
+ *     ".example.com" all match example.com and its subdomains; an entry
+ *     "example.com/terms" only matches URIs starting with /terms
+ *   - a sorted table of merged IPv4 / IPv6 ranges (addresses and CIDRs),
+ *     checked against IP-literal hosts
+ * A lookup is one hash probe per host label plus one binary search.
+ *
+ * Walled-garden domains do reach nginx: portal-fw.sh lets only bypass
+ * MACs (src) and portal_bypass_ip (dst) skip the redirect, and leaves the
+ * dnsmasq-filled portal_bypass_dns set alone. The host matched here is
+ * X-Original-Host, which the client chooses, so the caller only asks for
+ * requests nginx proxies to portal_server (X-Portal-Upstream, set by
+ * nginx and never taken from the client). A forged Host then gets the
+ * portal server's own pages and nothing else; probe URIs never qualify.
+ *
+ * Bypass MACs are not loaded: portal-fw.sh RETURNs them before the
+ * redirect, so their requests never reach the signer.
+ *
+ * The env file is re-checked once a second and on SIGHUP; a changed file
+ * is compiled off to the side and swapped in. Single-threaded (main loop).
+ */
+
+/* Reload from cfg->bypass_env now. Returns entries loaded, -1 on error. */
+int  bypass_load(const signer_config_t *cfg);
+
+/* Reload if the env file changed since the last load. */
+void bypass_tick(const signer_config_t *cfg);
+
+/* 1 if host (may carry a port) + uri is on the allow-list. */
+int  bypass_match(const char *host, const char *uri);
+
+void bypass_stop(void);
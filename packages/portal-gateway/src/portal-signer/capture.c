@@ -0,0 +1,170 @@
+#include "capture.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAPTURE_BUF         (64 * 1024)
+#define CAPTURE_REC_MAX     (sizeof(capture_rec_hdr_t) + 8 * (3 + CAPTURE_FIELD_MAX))
+#define CAPTURE_FLUSH_US    1000000u
+
+_Static_assert(sizeof(capture_file_hdr_t) == 16, "capture_file_hdr_t layout changed");
+_Static_assert(sizeof(capture_rec_hdr_t) == 24, "capture_rec_hdr_t layout changed");
+
+static int           g_fd = -1;
+static char          g_path[128];
+static char         *g_buf;
+static size_t        g_len;
+static uint64_t      g_written;
+static uint64_t      g_limit;
+static uint64_t      g_t0_us;
+static uint64_t      g_first_us;        /* oldest buffered record */
+static unsigned long g_records;
+static unsigned long g_skipped;
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static void flush_buf(void) {
+    size_t off = 0;
+    while (off < g_len) {
+        ssize_t w = write(g_fd, g_buf + off, g_len - off);
+        if (w <= 0) break;
+        off += (size_t)w;
+    }
+    g_written += off;
+    g_len = 0;
+}
+
+static size_t put_field(char *p, int id, const char *v, size_t cap) {
+    size_t n = strnlen(v, cap < CAPTURE_FIELD_MAX ? cap : CAPTURE_FIELD_MAX);
+    if (!n) return 0;
+
+    uint16_t len = (uint16_t)n;
+    p[0] = (char)id;
+    memcpy(p + 1, &len, sizeof(len));
+    memcpy(p + 3, v, n);
+    return 3 + n;
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int capture_enabled(void) {
+    return g_fd >= 0;
+}
+
+void capture_push(uint64_t t_arrival, const char *method, const char *uri,
+                  const char *host, const portal_client_t *hdr, int status, int verdict,
+                  int source, uint32_t ctrl_us, uint32_t total_us) {
+    if (g_fd < 0) return;
+
+    if (g_written + g_len + CAPTURE_REC_MAX > g_limit) {
+        g_skipped++;
+        return;
+    }
+    if (g_len + CAPTURE_REC_MAX > CAPTURE_BUF)
+        flush_buf();
+    if (!g_len)
+        g_first_us = mono_us();
+
+    char *rec = g_buf + g_len;
+    size_t off = sizeof(capture_rec_hdr_t);
+    uint8_t nf = 0;
+    char vlan[16] = "";
+    if (hdr->vlan_id)
+        snprintf(vlan, sizeof(vlan), "%d", hdr->vlan_id);
+
+#define PUT(id, v, cap) do { size_t n_ = put_field(rec + off, id, v, cap); if (n_) { off += n_; nf++; } } while (0)
+    PUT(CAPTURE_F_METHOD, method,     CAPTURE_FIELD_MAX);
+    PUT(CAPTURE_F_URI,    uri,        CAPTURE_FIELD_MAX);
+    PUT(CAPTURE_F_IP,     hdr->ip,    sizeof(hdr->ip));
+    PUT(CAPTURE_F_MAC,    hdr->mac,   sizeof(hdr->mac));
+    PUT(CAPTURE_F_SSID,   hdr->ssid,  sizeof(hdr->ssid));
+    PUT(CAPTURE_F_RADIO,  hdr->radio, sizeof(hdr->radio));
+    PUT(CAPTURE_F_VLAN,   vlan,       sizeof(vlan));
+    PUT(CAPTURE_F_HOST,   host,       CAPTURE_FIELD_MAX);
+#undef PUT
+
+    capture_rec_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    h.len = (uint16_t)off;
+    h.status = (uint16_t)status;
+    h.verdict = (uint8_t)verdict;
+    h.source = (uint8_t)source;
+    h.nfields = nf;
+    h.ctrl_us = ctrl_us;
+    h.total_us = total_us;
+    h.t_us = t_arrival > g_t0_us ? t_arrival - g_t0_us : 0;
+    memcpy(rec, &h, sizeof(h));
+
+    g_len += off;
+    g_records++;
+}
+
+void capture_tick(void) {
+    if (g_fd < 0 || !g_len) return;
+    if (mono_us() - g_first_us >= CAPTURE_FLUSH_US)
+        flush_buf();
+}
+
+int capture_start(const signer_config_t *cfg) {
+    if (!cfg->capture_enable)
+        return 0;
+
+    snprintf(g_path, sizeof(g_path), "%s", cfg->capture_path);
+    g_buf = (char *)malloc(CAPTURE_BUF);
+    if (!g_buf) return -1;
+
+    g_fd = open(g_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (g_fd < 0) {
+        fprintf(stderr, "[portal-signer] capture: cannot open %s\n", g_path);
+        free(g_buf);
+        g_buf = NULL;
+        return -1;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    capture_file_hdr_t fh;
+    memcpy(fh.magic, CAPTURE_MAGIC, sizeof(fh.magic));
+    fh.start_ms = (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+    memcpy(g_buf, &fh, sizeof(fh));
+    g_len = sizeof(fh);
+    g_first_us = mono_us();
+    g_t0_us = g_first_us;
+
+    g_written = 0;
+    g_limit = cfg->capture_max_kb > 0 ? (uint64_t)cfg->capture_max_kb * 1024u : UINT64_MAX;
+    g_records = 0;
+    g_skipped = 0;
+
+    fprintf(stderr, "[portal-signer] capture: recording to %s\n", g_path);
+    return 0;
+}
+
+void capture_stop(void) {
+    if (g_fd < 0) return;
+
+    flush_buf();
+    close(g_fd);
+    g_fd = -1;
+    free(g_buf);
+    g_buf = NULL;
+
+    fprintf(stderr, "[portal-signer] capture: %lu requests written to %s",
+            g_records, g_path);
+    if (g_skipped)
+        fprintf(stderr, ", %lu skipped (capture.max_kb)", g_skipped);
+    fprintf(stderr, "\n");
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "config.h"
+#include "signer.h"
+
+/*
+ * Request capture (capture.*) for offline replay with portal-replay.
+ *
+ * Every verify-path request is appended to a binary trace with its
+ * arrival time, the headers nginx sent and the outcome. Records are
+ * buffered and written from the main loop; once capture.max_kb is
+ * reached further requests are counted but not written.
+ *
+ * File layout, host byte order:
+ *   capture_file_hdr_t
+ *   { capture_rec_hdr_t, nfields x { u8 id, u16 len, len bytes } } ...
+ *
+ * Fields carry the header values exactly as received (before the live
+ * client context fills gaps); absent headers are not recorded.
+ */
+
+#define CAPTURE_MAGIC       "PSCAP001"
+#define CAPTURE_FIELD_MAX   512
+
+typedef enum {
+    CAPTURE_F_METHOD = 1,       /* X-Original-Method */
+    CAPTURE_F_URI,              /* X-Original-URI */
+    CAPTURE_F_IP,               /* X-Client-IP */
+    CAPTURE_F_MAC,              /* X-Client-MAC */
+    CAPTURE_F_SSID,             /* X-Client-SSID */
+    CAPTURE_F_RADIO,            /* X-Client-Radio-ID */
+    CAPTURE_F_VLAN,             /* X-Portal-VLAN-ID, decimal */
+    CAPTURE_F_HOST,             /* X-Original-Host */
+} capture_field_t;
+
+/* 16 bytes */
+typedef struct {
+    char     magic[8];
+    uint64_t start_ms;          /* wall clock at capture start, unix ms */
+} capture_file_hdr_t;
+
+/* 24 bytes, followed by the fields */
+typedef struct {
+    uint16_t len;               /* whole record */
+    uint16_t status;            /* HTTP status returned to nginx */
+    uint8_t  verdict;           /* declog_verdict_t */
+    uint8_t  source;            /* declog_source_t */
+    uint8_t  nfields;
+    uint8_t  reserved;
+    uint32_t ctrl_us;           /* controller round trip, 0 if not asked */
+    uint32_t total_us;
+    uint64_t t_us;              /* arrival, us since capture start */
+} capture_rec_hdr_t;
+
+/* Open the trace. Returns 0 on success (or if disabled). */
+int  capture_start(const signer_config_t *cfg);
+
+/* Write what is buffered and close the trace. */
+void capture_stop(void);
+
+/* 1 if requests are being recorded. */
+int  capture_enabled(void);
+
+/*
+ * Record one request. `hdr` holds the client headers as received,
+ * `t_arrival` is the monotonic arrival time in us.
+ */
+void capture_push(uint64_t t_arrival, const char *method, const char *uri,
+                  const char *host, const portal_client_t *hdr, int status, int verdict,
+                  int source, uint32_t ctrl_us, uint32_t total_us);
+
+/* Write buffered records if they are older than a second. */
+void capture_tick(void);
@@ -0,0 +1,826 @@
+#include "clientctx.h"
+#include "nl.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/genetlink.h>
+#include <linux/neighbour.h>
+#include <linux/nl80211.h>
+#include <linux/rtnetlink.h>
+
+#define CTX_WAYS      4
+#define CTX_IFACES    128
+#define CTX_MSG_BUF   256
+
+typedef struct {
+    uint8_t  used;
+    uint8_t  family;
+    uint8_t  mac[6];
+    int32_t  ifindex;
+    uint8_t  addr[16];
+    uint8_t  stale;             /* not yet confirmed by the resync dump */
+} ctx_neigh_t;
+
+typedef struct {
+    uint8_t  used;
+    uint8_t  mac[6];
+    uint8_t  stale;             /* not yet confirmed by the resync dump */
+    int32_t  ifindex;
+} ctx_sta_t;
+
+typedef struct {
+    int32_t  ifindex;           /* 0 = free */
+    char     name[IFNAMSIZ];
+    int      vlan_id;
+    int      is_ap;
+    int      probed;            /* seen in an nl80211 interface dump */
+    char     ssid[33];
+} ctx_iface_t;
+
+static ctx_neigh_t *g_neigh;
+static ctx_sta_t   *g_sta;
+static uint32_t     g_neigh_mask;
+static uint32_t     g_sta_mask;
+static uint8_t     *g_neigh_hand;
+static uint8_t     *g_sta_hand;
+
+static ctx_iface_t  g_ifaces[CTX_IFACES];
+static int          g_iface_stale;      /* re-read AP interfaces after this event batch */
+
+static int          g_neigh_fd = -1;
+static int          g_wifi_fd = -1;
+static int          g_nl80211_id;
+
+/* Resync dumps are sent on the event sockets and finish in the drain */
+enum { WIFI_DUMP_NONE, WIFI_DUMP_IFACES, WIFI_DUMP_STATIONS };
+
+static int          g_neigh_dumping;
+static int          g_neigh_redump;     /* events lost again meanwhile */
+static int          g_wifi_dump;        /* WIFI_DUMP_* in flight */
+static int          g_wifi_dump_ap;     /* next g_ifaces[] slot to dump stations of */
+static int          g_wifi_dump_sta;    /* this resync re-reads stations too */
+static int          g_wifi_dump_intr;   /* a station dump was interrupted */
+static int          g_wifi_pending;     /* queued resync: 1 = interfaces, 2 = + stations */
+
+static unsigned long g_neigh_evicted;
+static time_t        g_evict_logged;
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static uint32_t fnv32(const void *p, size_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= b[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t sets_for(unsigned int n) {
+    uint32_t sets = 1;
+    while ((uint64_t)sets * CTX_WAYS < n && sets < (1u << 20))
+        sets <<= 1;
+    return sets;
+}
+
+static int parse_mac(const char *s, uint8_t mac[6]) {
+    unsigned int m[6];
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+        return -1;
+    for (int i = 0; i < 6; i++)
+        mac[i] = (uint8_t)m[i];
+    return 0;
+}
+
+static void format_mac(char out[18], const uint8_t mac[6]) {
+    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/* "br-lan.10" -> 10, otherwise 0 (same rule as portal-agent.sh) */
+static int vlan_from_ifname(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || !dot[1]) return 0;
+    for (const char *p = dot + 1; *p; p++)
+        if (!isdigit((unsigned char)*p)) return 0;
+    return atoi(dot + 1);
+}
+
+/* SSIDs are raw bytes; keep them safe to echo in a response header */
+static void copy_ssid(char out[33], const uint8_t *ssid, size_t len) {
+    if (len > 32) len = 32;
+    for (size_t i = 0; i < len; i++)
+        out[i] = (ssid[i] < 0x20 || ssid[i] == 0x7f) ? '?' : (char)ssid[i];
+    out[len] = '\0';
+}
+
+static ctx_iface_t *iface_find(int ifindex) {
+    for (int i = 0; i < CTX_IFACES; i++)
+        if (g_ifaces[i].ifindex == ifindex) return &g_ifaces[i];
+    return NULL;
+}
+
+static void iface_set_name(ctx_iface_t *ifc, const char *name, size_t len) {
+    if (len >= sizeof(ifc->name)) len = sizeof(ifc->name) - 1;
+    memcpy(ifc->name, name, len);
+    ifc->name[len] = '\0';
+    ifc->vlan_id = vlan_from_ifname(ifc->name);
+}
+
+/*
+ * Entry for `ifindex`, created on first use. Entries are only freed by
+ * link / nl80211 delete events, so a full table never evicts a live one.
+ */
+static ctx_iface_t *iface_get(int ifindex) {
+    ctx_iface_t *ifc = iface_find(ifindex);
+    if (ifc) return ifc;
+
+    char name[IFNAMSIZ];
+    if (ifindex <= 0 || !if_indextoname((unsigned int)ifindex, name))
+        return NULL;
+
+    ifc = iface_find(0);
+    if (!ifc) return NULL;
+    memset(ifc, 0, sizeof(*ifc));
+    ifc->ifindex = ifindex;
+    iface_set_name(ifc, name, strlen(name));
+    return ifc;
+}
+
+static void iface_del(int ifindex) {
+    ctx_iface_t *ifc = ifindex > 0 ? iface_find(ifindex) : NULL;
+    if (ifc) memset(ifc, 0, sizeof(*ifc));
+}
+
+/* After lost link events: drop interfaces that are gone, pick up renames */
+static void iface_revalidate(void) {
+    for (int i = 0; i < CTX_IFACES; i++) {
+        ctx_iface_t *ifc = &g_ifaces[i];
+        char name[IFNAMSIZ];
+        if (!ifc->ifindex) continue;
+        if (!if_indextoname((unsigned int)ifc->ifindex, name))
+            memset(ifc, 0, sizeof(*ifc));
+        else
+            iface_set_name(ifc, name, strlen(name));
+    }
+}
+
+/* --------------------------------------------------
+ * Tables
+ * -------------------------------------------------- */
+static ctx_neigh_t *neigh_ways(int family, const uint8_t addr[16], uint32_t *set) {
+    uint8_t key[17];
+    key[0] = (uint8_t)family;
+    memcpy(key + 1, addr, 16);
+    *set = fnv32(key, sizeof(key)) & g_neigh_mask;
+    return &g_neigh[(size_t)*set * CTX_WAYS];
+}
+
+static ctx_neigh_t *neigh_find(int family, const uint8_t addr[16]) {
+    uint32_t set;
+    ctx_neigh_t *w = neigh_ways(family, addr, &set);
+    for (int i = 0; i < CTX_WAYS; i++)
+        if (w[i].used && w[i].family == family && !memcmp(w[i].addr, addr, 16))
+            return &w[i];
+    return NULL;
+}
+
+/* A full set replaces a live entry; that client then resolves from headers only */
+static void neigh_evicted(void) {
+    g_neigh_evicted++;
+    time_t now = time(NULL);
+    if (now - g_evict_logged < 10) return;
+    g_evict_logged = now;
+    fprintf(stderr, "[portal-signer] clientctx: neighbour set full, %lu entries evicted, "
+                    "raise ctx.clients\n", g_neigh_evicted);
+}
+
+static void neigh_put(int family, const uint8_t addr[16], const uint8_t mac[6], int ifindex) {
+    ctx_neigh_t *e = neigh_find(family, addr);
+    if (!e) {
+        uint32_t set;
+        ctx_neigh_t *w = neigh_ways(family, addr, &set);
+        for (int i = 0; i < CTX_WAYS && !e; i++)
+            if (!w[i].used) e = &w[i];
+        if (!e) {
+            e = &w[g_neigh_hand[set]];
+            g_neigh_hand[set] = (uint8_t)((g_neigh_hand[set] + 1) % CTX_WAYS);
+            neigh_evicted();
+        }
+        e->used = 1;
+        e->family = (uint8_t)family;
+        memcpy(e->addr, addr, 16);
+    }
+    memcpy(e->mac, mac, 6);
+    e->ifindex = ifindex;
+    e->stale = 0;
+}
+
+/* Before a resync dump: flag every entry; the dump and events clear the flag */
+static void neigh_mark(void) {
+    size_t n = (size_t)(g_neigh_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++)
+        g_neigh[i].stale = g_neigh[i].used;
+}
+
+/* After it: drop what was not confirmed (`drop` = 0 if the dump failed) */
+static void neigh_sweep(int drop) {
+    size_t n = (size_t)(g_neigh_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++) {
+        if (g_neigh[i].stale && drop) g_neigh[i].used = 0;
+        g_neigh[i].stale = 0;
+    }
+}
+
+static ctx_sta_t *sta_ways(const uint8_t mac[6], uint32_t *set) {
+    *set = fnv32(mac, 6) & g_sta_mask;
+    return &g_sta[(size_t)*set * CTX_WAYS];
+}
+
+static ctx_sta_t *sta_find(const uint8_t mac[6]) {
+    uint32_t set;
+    ctx_sta_t *w = sta_ways(mac, &set);
+    for (int i = 0; i < CTX_WAYS; i++)
+        if (w[i].used && !memcmp(w[i].mac, mac, 6))
+            return &w[i];
+    return NULL;
+}
+
+static void sta_put(const uint8_t mac[6], int ifindex) {
+    ctx_sta_t *e = sta_find(mac);
+    if (!e) {
+        uint32_t set;
+        ctx_sta_t *w = sta_ways(mac, &set);
+        for (int i = 0; i < CTX_WAYS && !e; i++)
+            if (!w[i].used) e = &w[i];
+        if (!e) {
+            e = &w[g_sta_hand[set]];
+            g_sta_hand[set] = (uint8_t)((g_sta_hand[set] + 1) % CTX_WAYS);
+        }
+        e->used = 1;
+        memcpy(e->mac, mac, 6);
+    }
+    e->ifindex = ifindex;
+    e->stale = 0;
+}
+
+static void sta_mark(void) {
+    size_t n = (size_t)(g_sta_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++)
+        g_sta[i].stale = g_sta[i].used;
+}
+
+static void sta_sweep(int drop) {
+    size_t n = (size_t)(g_sta_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++) {
+        if (g_sta[i].stale && drop) g_sta[i].used = 0;
+        g_sta[i].stale = 0;
+    }
+}
+
+/* --------------------------------------------------
+ * rtnetlink neighbours / links
+ * -------------------------------------------------- */
+static void on_link_msg(const struct nlmsghdr *n) {
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+        return;
+
+    const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(n);
+    if (n->nlmsg_type == RTM_DELLINK) {
+        iface_del(ifi->ifi_index);
+        return;
+    }
+
+    /* Only interfaces already in use are tracked; pick up renames */
+    ctx_iface_t *ifc = iface_find(ifi->ifi_index);
+    if (!ifc) return;
+
+    const struct nlattr *tb[IFLA_MAX + 1];
+    nl_parse((const char *)ifi + NLMSG_ALIGN(sizeof(*ifi)),
+             n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi)), tb, IFLA_MAX);
+    if (tb[IFLA_IFNAME])
+        iface_set_name(ifc, (const char *)nl_data(tb[IFLA_IFNAME]),
+                       strnlen((const char *)nl_data(tb[IFLA_IFNAME]), nl_len(tb[IFLA_IFNAME])));
+}
+
+static void neigh_resync(void);
+
+/* End of a resync dump; an interrupted one drops nothing and is read again */
+static void neigh_dump_done(const struct nlmsghdr *n) {
+    int intr = (n->nlmsg_flags & NLM_F_DUMP_INTR) != 0;
+    g_neigh_dumping = 0;
+    neigh_sweep(n->nlmsg_type == NLMSG_DONE && !intr);
+    if (intr)
+        g_neigh_redump = 1;
+    if (g_neigh_redump) {
+        g_neigh_redump = 0;
+        neigh_resync();
+    }
+}
+
+static void on_neigh_msg(const struct nlmsghdr *n, void *arg) {
+    (void)arg;
+    if (n->nlmsg_type == NLMSG_DONE || n->nlmsg_type == NLMSG_ERROR) {
+        if (g_neigh_dumping) neigh_dump_done(n);
+        return;
+    }
+    if (n->nlmsg_type == RTM_NEWLINK || n->nlmsg_type == RTM_DELLINK) {
+        on_link_msg(n);
+        return;
+    }
+    if (n->nlmsg_type != RTM_NEWNEIGH && n->nlmsg_type != RTM_DELNEIGH)
+        return;
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct ndmsg)))
+        return;
+
+    const struct ndmsg *nd = (const struct ndmsg *)NLMSG_DATA(n);
+    if (nd->ndm_family != AF_INET && nd->ndm_family != AF_INET6)
+        return;
+
+    const struct nlattr *tb[NDA_MAX + 1];
+    nl_parse((const char *)nd + NLMSG_ALIGN(sizeof(*nd)),
+             n->nlmsg_len - NLMSG_LENGTH(sizeof(*nd)), tb, NDA_MAX);
+
+    if (!tb[NDA_DST]) return;
+
+    uint8_t addr[16] = {0};
+    size_t alen = nl_len(tb[NDA_DST]);
+    if (alen > sizeof(addr)) return;
+    memcpy(addr, nl_data(tb[NDA_DST]), alen);
+
+    int gone = n->nlmsg_type == RTM_DELNEIGH ||
+               (nd->ndm_state & (NUD_FAILED | NUD_INCOMPLETE | NUD_NOARP)) ||
+               !tb[NDA_LLADDR] || nl_len(tb[NDA_LLADDR]) != 6;
+
+    if (gone) {
+        ctx_neigh_t *e = neigh_find(nd->ndm_family, addr);
+        if (e) e->used = 0;
+        return;
+    }
+
+    neigh_put(nd->ndm_family, addr, (const uint8_t *)nl_data(tb[NDA_LLADDR]), nd->ndm_ifindex);
+    (void)iface_get(nd->ndm_ifindex);
+}
+
+static struct nlmsghdr *neigh_dump_msg(char *buf, size_t cap) {
+    struct nlmsghdr *n = nl_msg_init(buf, cap, RTM_GETNEIGH, NLM_F_DUMP, sizeof(struct ndmsg));
+    ((struct ndmsg *)nl_msg_data(n))->ndm_family = AF_UNSPEC;
+    return n;
+}
+
+/* Startup seed (blocking) */
+static void neigh_dump(void) {
+    char buf[CTX_MSG_BUF];
+    (void)nl_transact(NETLINK_ROUTE, neigh_dump_msg(buf, sizeof(buf)), on_neigh_msg, NULL);
+}
+
+/*
+ * After lost events: dump on the event socket, answered through the
+ * drain. Entries the dump does not confirm (a lost RTM_DELNEIGH) are
+ * dropped when it completes, so an IP never keeps a previous client's MAC.
+ */
+static void neigh_resync(void) {
+    if (g_neigh_dumping) {
+        g_neigh_redump = 1;
+        return;
+    }
+    char buf[CTX_MSG_BUF];
+    neigh_mark();
+    if (nl_send(g_neigh_fd, neigh_dump_msg(buf, sizeof(buf))) != 0) {
+        neigh_sweep(0);
+        return;
+    }
+    g_neigh_dumping = 1;
+}
+
+/* --------------------------------------------------
+ * nl80211 stations
+ * -------------------------------------------------- */
+typedef struct {
+    int id;
+    int mlme_grp;
+    int config_grp;
+} genl_family_t;
+
+static void on_family_msg(const struct nlmsghdr *n, void *arg) {
+    genl_family_t *fam = (genl_family_t *)arg;
+    const struct nlattr *tb[CTRL_ATTR_MAX + 1];
+
+    nl_parse((const char *)NLMSG_DATA(n) + GENL_HDRLEN,
+             n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), tb, CTRL_ATTR_MAX);
+
+    if (tb[CTRL_ATTR_FAMILY_ID])
+        fam->id = *(const uint16_t *)nl_data(tb[CTRL_ATTR_FAMILY_ID]);
+
+    if (!tb[CTRL_ATTR_MCAST_GROUPS]) return;
+
+    /* Nested list of { NAME, ID } entries */
+    const char *p = (const char *)nl_data(tb[CTRL_ATTR_MCAST_GROUPS]);
+    size_t len = nl_len(tb[CTRL_ATTR_MCAST_GROUPS]);
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr *grp = (const struct nlattr *)p;
+        if (grp->nla_len < NLA_HDRLEN || grp->nla_len > len) break;
+
+        const struct nlattr *g[CTRL_ATTR_MCAST_GRP_MAX + 1];
+        nl_parse(nl_data(grp), nl_len(grp), g, CTRL_ATTR_MCAST_GRP_MAX);
+        if (g[CTRL_ATTR_MCAST_GRP_NAME] && g[CTRL_ATTR_MCAST_GRP_ID]) {
+            const char *name = (const char *)nl_data(g[CTRL_ATTR_MCAST_GRP_NAME]);
+            int id = (int)nl_get_u32(g[CTRL_ATTR_MCAST_GRP_ID]);
+            if (!strcmp(name, NL80211_MULTICAST_GROUP_MLME))
+                fam->mlme_grp = id;
+            else if (!strcmp(name, NL80211_MULTICAST_GROUP_CONFIG))
+                fam->config_grp = id;
+        }
+
+        size_t step = NLA_ALIGN(grp->nla_len);
+        if (step >= len) break;
+        p += step;
+        len -= step;
+    }
+}
+
+static int nl80211_resolve(genl_family_t *fam) {
+    char buf[CTX_MSG_BUF];
+    struct nlmsghdr *n = nl_msg_init(buf, sizeof(buf), GENL_ID_CTRL, 0, GENL_HDRLEN);
+    struct genlmsghdr *g = (struct genlmsghdr *)nl_msg_data(n);
+    g->cmd = CTRL_CMD_GETFAMILY;
+    g->version = 1;
+    nl_put_str(n, sizeof(buf), CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME);
+
+    memset(fam, 0, sizeof(*fam));
+    int rc = nl_transact(NETLINK_GENERIC, n, on_family_msg, fam);
+    return (rc == 0 && fam->id > 0) ? 0 : -1;
+}
+
+static const struct nlattr **wifi_attrs(const struct nlmsghdr *n, const struct nlattr **tb) {
+    nl_parse((const char *)NLMSG_DATA(n) + GENL_HDRLEN,
+             n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), tb, NL80211_ATTR_MAX);
+    return tb;
+}
+
+static void on_iface_msg(const struct nlmsghdr *n, void *arg) {
+    (void)arg;
+    if (n->nlmsg_type != g_nl80211_id) return;
+
+    const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    wifi_attrs(n, tb);
+    if (!tb[NL80211_ATTR_IFINDEX]) return;
+
+    ctx_iface_t *ifc = iface_get((int)nl_get_u32(tb[NL80211_ATTR_IFINDEX]));
+    if (!ifc) return;
+
+    ifc->probed = 1;
+    ifc->is_ap = tb[NL80211_ATTR_IFTYPE] &&
+                 nl_get_u32(tb[NL80211_ATTR_IFTYPE]) == NL80211_IFTYPE_AP;
+    if (tb[NL80211_ATTR_SSID])
+        copy_ssid(ifc->ssid, (const uint8_t *)nl_data(tb[NL80211_ATTR_SSID]),
+                  nl_len(tb[NL80211_ATTR_SSID]));
+    else
+        ifc->ssid[0] = '\0';       /* not beaconing */
+}
+
+static void on_station_msg(const struct nlmsghdr *n, void *arg) {
+    (void)arg;
+    if (n->nlmsg_type != g_nl80211_id) return;
+
+    const struct genlmsghdr *g = (const struct genlmsghdr *)NLMSG_DATA(n);
+    const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    wifi_attrs(n, tb);
+
+    if (!tb[NL80211_ATTR_MAC] || nl_len(tb[NL80211_ATTR_MAC]) != 6 ||
+        !tb[NL80211_ATTR_IFINDEX])
+        return;
+
+    const uint8_t *mac = (const uint8_t *)nl_data(tb[NL80211_ATTR_MAC]);
+    int ifindex = (int)nl_get_u32(tb[NL80211_ATTR_IFINDEX]);
+
+    if (g->cmd == NL80211_CMD_DEL_STATION) {
+        ctx_sta_t *e = sta_find(mac);
+        if (e && e->ifindex == ifindex) e->used = 0;
+    } else if (g->cmd == NL80211_CMD_NEW_STATION) {
+        sta_put(mac, ifindex);
+        /* AP interface not seen yet: read names / SSIDs after this batch */
+        const ctx_iface_t *ifc = iface_get(ifindex);
+        if (ifc && !ifc->probed)
+            g_iface_stale = 1;
+    }
+}
+
+static void wifi_dump_done(const struct nlmsghdr *n);
+
+/* Events on the mlme + config groups, and replies to resync dumps */
+static void on_wifi_msg(const struct nlmsghdr *n, void *arg) {
+    if (n->nlmsg_type == NLMSG_DONE || n->nlmsg_type == NLMSG_ERROR) {
+        if (g_wifi_dump != WIFI_DUMP_NONE) wifi_dump_done(n);
+        return;
+    }
+    if (n->nlmsg_type != g_nl80211_id) return;
+
+    const struct genlmsghdr *g = (const struct genlmsghdr *)NLMSG_DATA(n);
+    switch (g->cmd) {
+    case NL80211_CMD_NEW_STATION:
+    case NL80211_CMD_DEL_STATION:
+        on_station_msg(n, arg);
+        break;
+    case NL80211_CMD_NEW_INTERFACE:
+    case NL80211_CMD_SET_INTERFACE:
+        on_iface_msg(n, arg);
+        break;
+    case NL80211_CMD_DEL_INTERFACE: {
+        const struct nlattr *tb[NL80211_ATTR_MAX + 1];
+        wifi_attrs(n, tb);
+        if (tb[NL80211_ATTR_IFINDEX])
+            iface_del((int)nl_get_u32(tb[NL80211_ATTR_IFINDEX]));
+        break;
+    }
+    case NL80211_CMD_START_AP:
+    case NL80211_CMD_STOP_AP:
+        /* SSID may have changed (hostapd reload) */
+        g_iface_stale = 1;
+        break;
+    default:
+        break;
+    }
+}
+
+static struct nlmsghdr *wifi_dump_msg(char *buf, size_t cap, uint8_t cmd, int ifindex) {
+    struct nlmsghdr *n = nl_msg_init(buf, cap, (uint16_t)g_nl80211_id, NLM_F_DUMP, GENL_HDRLEN);
+    ((struct genlmsghdr *)nl_msg_data(n))->cmd = cmd;
+    if (ifindex)
+        nl_put_u32(n, cap, NL80211_ATTR_IFINDEX, (uint32_t)ifindex);
+    return n;
+}
+
+/* Startup seed (blocking); the event path uses wifi_resync() */
+static void wifi_iface_dump(void) {
+    char buf[CTX_MSG_BUF];
+    (void)nl_transact(NETLINK_GENERIC,
+                      wifi_dump_msg(buf, sizeof(buf), NL80211_CMD_GET_INTERFACE, 0),
+                      on_iface_msg, NULL);
+}
+
+static void wifi_station_dump(void) {
+    for (int i = 0; i < CTX_IFACES; i++) {
+        if (!g_ifaces[i].ifindex || !g_ifaces[i].is_ap) continue;
+
+        char buf[CTX_MSG_BUF];
+        (void)nl_transact(NETLINK_GENERIC,
+                          wifi_dump_msg(buf, sizeof(buf), NL80211_CMD_GET_STATION,
+                                        g_ifaces[i].ifindex),
+                          on_station_msg, NULL);
+    }
+}
+
+/*
+ * Resync without blocking: an interface dump, then (with `stations`) one
+ * station dump per AP interface, each sent on the event socket once the
+ * previous one is done. Replies arrive as NEW_INTERFACE / NEW_STATION
+ * through on_wifi_msg(). Stations no dump confirms are dropped at the end.
+ */
+static void wifi_resync(int stations) {
+    if (g_wifi_dump != WIFI_DUMP_NONE) {
+        if (g_wifi_pending < 1 + stations) g_wifi_pending = 1 + stations;
+        return;
+    }
+    char buf[CTX_MSG_BUF];
+    if (nl_send(g_wifi_fd, wifi_dump_msg(buf, sizeof(buf), NL80211_CMD_GET_INTERFACE, 0)) != 0)
+        return;
+    g_wifi_dump = WIFI_DUMP_IFACES;
+    g_wifi_dump_sta = stations;
+}
+
+static void wifi_dump_finish(void) {
+    int pending = g_wifi_pending;
+    g_wifi_dump = WIFI_DUMP_NONE;
+    g_wifi_pending = 0;
+    if (pending) wifi_resync(pending - 1);
+}
+
+static void wifi_next_station_dump(void) {
+    while (g_wifi_dump_ap < CTX_IFACES) {
+        const ctx_iface_t *ifc = &g_ifaces[g_wifi_dump_ap++];
+        if (!ifc->ifindex || !ifc->is_ap) continue;
+
+        char buf[CTX_MSG_BUF];
+        if (nl_send(g_wifi_fd, wifi_dump_msg(buf, sizeof(buf), NL80211_CMD_GET_STATION,
+                                             ifc->ifindex)) != 0) {
+            sta_sweep(0);
+            wifi_dump_finish();
+            return;
+        }
+        g_wifi_dump = WIFI_DUMP_STATIONS;
+        return;
+    }
+    sta_sweep(!g_wifi_dump_intr);
+    wifi_dump_finish();
+}
+
+static void wifi_dump_done(const struct nlmsghdr *n) {
+    /* Changed while dumping: keep what is there and read it all again */
+    if (n->nlmsg_flags & NLM_F_DUMP_INTR) {
+        g_wifi_dump_intr = 1;
+        if (g_wifi_pending < 1 + g_wifi_dump_sta)
+            g_wifi_pending = 1 + g_wifi_dump_sta;
+    }
+
+    if (g_wifi_dump == WIFI_DUMP_IFACES) {
+        if (!g_wifi_dump_sta) {
+            wifi_dump_finish();
+            return;
+        }
+        sta_mark();
+        g_wifi_dump_ap = 0;
+        g_wifi_dump_intr = 0;
+    }
+    wifi_next_station_dump();
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int clientctx_neigh_fd(void) { return g_neigh_fd; }
+int clientctx_wifi_fd(void)  { return g_wifi_fd; }
+
+void clientctx_on_neigh(void) {
+    if (g_neigh_fd < 0) return;
+    if (nl_drain(g_neigh_fd, on_neigh_msg, NULL) == -ENOBUFS) {
+        iface_revalidate();
+        neigh_resync();
+    }
+}
+
+void clientctx_on_wifi(void) {
+    if (g_wifi_fd < 0) return;
+    if (nl_drain(g_wifi_fd, on_wifi_msg, NULL) == -ENOBUFS)
+        wifi_resync(1);
+    if (g_iface_stale) {
+        g_iface_stale = 0;
+        wifi_resync(0);
+    }
+}
+
+int clientctx_start(const signer_config_t *cfg) {
+    clientctx_stop();
+    if (!cfg->ctx_enable) return 0;
+
+    uint32_t ns = sets_for((unsigned int)cfg->ctx_clients);
+    g_neigh = (ctx_neigh_t *)calloc((size_t)ns * CTX_WAYS, sizeof(*g_neigh));
+    g_sta = (ctx_sta_t *)calloc((size_t)ns * CTX_WAYS, sizeof(*g_sta));
+    g_neigh_hand = (uint8_t *)calloc(ns, 1);
+    g_sta_hand = (uint8_t *)calloc(ns, 1);
+    if (!g_neigh || !g_sta || !g_neigh_hand || !g_sta_hand) {
+        clientctx_stop();
+        return -1;
+    }
+    g_neigh_mask = ns - 1;
+    g_sta_mask = ns - 1;
+
+    /* Subscribe first, then dump, so nothing falls in between */
+    g_neigh_fd = nl_open(NETLINK_ROUTE, RTMGRP_NEIGH | RTMGRP_LINK, 1);
+    if (g_neigh_fd < 0) {
+        clientctx_stop();
+        return -1;
+    }
+    neigh_dump();
+
+    genl_family_t fam;
+    if (nl80211_resolve(&fam) == 0 && fam.mlme_grp > 0) {
+        g_nl80211_id = fam.id;
+        g_wifi_fd = nl_open(NETLINK_GENERIC, 0, 1);
+        if (g_wifi_fd >= 0 &&
+            setsockopt(g_wifi_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                       &fam.mlme_grp, sizeof(fam.mlme_grp)) != 0) {
+            close(g_wifi_fd);
+            g_wifi_fd = -1;
+        }
+        /* Interface add / remove / type change; SSIDs still work without it */
+        if (g_wifi_fd >= 0 && fam.config_grp > 0)
+            (void)setsockopt(g_wifi_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                             &fam.config_grp, sizeof(fam.config_grp));
+        wifi_iface_dump();
+        wifi_station_dump();
+        g_iface_stale = 0;
+    } else {
+        fprintf(stderr, "[portal-signer] clientctx: nl80211 unavailable, neighbours only\n");
+    }
+
+    fprintf(stderr, "[portal-signer] clientctx: %u entries, neigh_fd=%d wifi_fd=%d\n",
+            ns * CTX_WAYS, g_neigh_fd, g_wifi_fd);
+    return 0;
+}
+
+void clientctx_stop(void) {
+    if (g_neigh_fd >= 0) close(g_neigh_fd);
+    if (g_wifi_fd >= 0) close(g_wifi_fd);
+    g_neigh_fd = -1;
+    g_wifi_fd = -1;
+    g_neigh_dumping = 0;
+    g_neigh_redump = 0;
+    g_wifi_dump = WIFI_DUMP_NONE;
+    g_wifi_pending = 0;
+
+    free(g_neigh);
+    free(g_sta);
+    free(g_neigh_hand);
+    free(g_sta_hand);
+    g_neigh = NULL;
+    g_sta = NULL;
+    g_neigh_hand = NULL;
+    g_sta_hand = NULL;
+    memset(g_ifaces, 0, sizeof(g_ifaces));
+    g_iface_stale = 0;
+}
+
+void clientctx_resolve(portal_client_t *cli) {
+    if (!g_neigh || !cli->ip[0]) return;
+
+    uint8_t addr[16] = {0};
+    int family = AF_INET;
+    if (inet_pton(AF_INET, cli->ip, addr) != 1) {
+        family = AF_INET6;
+        if (inet_pton(AF_INET6, cli->ip, addr) != 1) return;
+    }
+
+    uint8_t mac[6];
+    int have_mac = cli->mac[0] && parse_mac(cli->mac, mac) == 0;
+
+    const ctx_neigh_t *ne = neigh_find(family, addr);
+    if (ne) {
+        if (!have_mac) {
+            memcpy(mac, ne->mac, 6);
+            have_mac = 1;
+            format_mac(cli->mac, mac);
+        }
+        if (cli->vlan_id == 0) {
+            const ctx_iface_t *ifc = iface_find(ne->ifindex);
+            if (ifc) cli->vlan_id = ifc->vlan_id;
+        }
+    }
+
+    if (!have_mac) return;
+
+    const ctx_sta_t *st = sta_find(mac);
+    if (!st) return;
+
+    /* Interfaces are kept current from the event sockets; never dump here */
+    const ctx_iface_t *ifc = iface_find(st->ifindex);
+    if (!ifc) return;
+
+    if (!cli->radio[0])
+        snprintf(cli->radio, sizeof(cli->radio), "%s", ifc->name);
+    if (!cli->ssid[0] && ifc->ssid[0])
+        snprintf(cli->ssid, sizeof(cli->ssid), "%s", ifc->ssid);
+}
+
+void clientctx_foreach_neigh(void (*fn)(const clientctx_neigh_row_t *row, void *arg), void *arg) {
+    if (!g_neigh) return;
+
+    size_t n = ((size_t)g_neigh_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++) {
+        const ctx_neigh_t *e = &g_neigh[i];
+        if (!e->used) continue;
+
+        const ctx_iface_t *ifc = iface_find(e->ifindex);
+        if (!ifc) continue;
+
+        clientctx_neigh_row_t row;
+        memset(&row, 0, sizeof(row));
+        row.family = e->family;
+        memcpy(row.addr, e->addr, 16);
+        if (!inet_ntop(e->family, e->addr, row.ip, sizeof(row.ip))) continue;
+        format_mac(row.mac, e->mac);
+        snprintf(row.ifname, sizeof(row.ifname), "%s", ifc->name);
+        row.vlan_id = ifc->vlan_id;
+        fn(&row, arg);
+    }
+}
+
+void clientctx_foreach_sta(void (*fn)(const clientctx_sta_row_t *row, void *arg), void *arg) {
+    if (!g_sta) return;
+
+    size_t n = ((size_t)g_sta_mask + 1) * CTX_WAYS;
+    for (size_t i = 0; i < n; i++) {
+        const ctx_sta_t *e = &g_sta[i];
+        if (!e->used) continue;
+
+        const ctx_iface_t *ifc = iface_find(e->ifindex);
+        if (!ifc) continue;
+
+        clientctx_sta_row_t row;
+        format_mac(row.mac, e->mac);
+        snprintf(row.radio, sizeof(row.radio), "%s", ifc->name);
+        snprintf(row.ssid, sizeof(row.ssid), "%s", ifc->ssid);
+        fn(&row, arg);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "signer.h"
+
+/*
+ * Live client context table (IP -> MAC/VLAN, MAC -> radio/SSID).
+ *
+ * Replaces the polling `ip neigh` / `iw station dump` maps written by
+ * portal-agent.sh with kernel events:
+ *   - rtnetlink RTNLGRP_NEIGH  : neighbour add/update/delete
+ *   - rtnetlink RTNLGRP_LINK   : interface rename/delete
+ *   - nl80211 "mlme" group     : station associate/disassociate, AP start/stop
+ *   - nl80211 "config" group   : wireless interface add/remove/type change
+ *
+ * Both are seeded with a dump at startup and then kept current from the
+ * event sockets, which the main loop polls. VLAN is taken from the
+ * neighbour's L3 interface name ("br-lan.10" -> 10), radio is the AP
+ * interface name and SSID comes from NL80211_CMD_GET_INTERFACE, re-read
+ * when an AP starts or stops. After that, and after lost events (ENOBUFS),
+ * dumps are sent on the event sockets and their replies handled in the
+ * drain, so neither lookups nor event handling block. A resync drops the
+ * entries its dump does not confirm. A full set replaces a live neighbour
+ * and logs it (raise ctx.clients).
+ *
+ * Fixed-size 4-way set-associative tables; not thread-safe.
+ */
+
+/* Open sockets and seed the tables. Returns 0 (also if disabled). */
+int  clientctx_start(const signer_config_t *cfg);
+void clientctx_stop(void);
+
+/* Event fds for the main poll loop (-1 when unused). */
+int  clientctx_neigh_fd(void);
+int  clientctx_wifi_fd(void);
+
+/* Process pending events on the respective socket. */
+void clientctx_on_neigh(void);
+void clientctx_on_wifi(void);
+
+/* Fill empty MAC / VLAN / radio / SSID fields of `cli` from cli->ip. */
+void clientctx_resolve(portal_client_t *cli);
+
+/* Table rows as seen by portal-ctxmap. */
+typedef struct {
+    int         family;
+    uint8_t     addr[16];
+    char        ip[INET6_ADDRSTRLEN];
+    char        mac[18];
+    char        ifname[IFNAMSIZ];
+    int         vlan_id;
+} clientctx_neigh_row_t;
+
+typedef struct {
+    char        mac[18];
+    char        radio[IFNAMSIZ];
+    char        ssid[33];       /* "" if the AP reported none */
+} clientctx_sta_row_t;
+
+/* Walk the current tables (unordered). */
+void clientctx_foreach_neigh(void (*fn)(const clientctx_neigh_row_t *row, void *arg), void *arg);
+void clientctx_foreach_sta(void (*fn)(const clientctx_sta_row_t *row, void *arg), void *arg);
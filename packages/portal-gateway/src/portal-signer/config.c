@@ -16,8 +16,68 @@ void signer_config_defaults(signer_config_t *cfg)
     strcpy(cfg->controller_addr, "127.0.0.1");
     cfg->controller_port = 9090;
     strcpy(cfg->controller_path, "/portal/context/verify");
+    cfg->controller_endpoints[0] = '\0';
+    cfg->controller_timeout_ms = 2000;
+    cfg->controller_eject_failures = 3;
+    cfg->controller_eject_ms = 5000;
+    cfg->controller_health_path[0] = '\0';
+    cfg->controller_health_interval = 5;
+    cfg->controller_hedge = 0;
+    cfg->controller_hedge_min_ms = 5;
 
     strcpy(cfg->key_file, "/etc/portal/portal.signing.key");
+    cfg->sign_raw_max_kb = 65536;
+    cfg->sign_raw_timeout_ms = 2000;
+
+    cfg->ratelimit_enable = 0;
+    cfg->ratelimit_clients = 16384;
+    cfg->ratelimit_rate = 5;
+    cfg->ratelimit_burst = 20;
+    cfg->ratelimit_verdict_ttl = 30;
+    cfg->ratelimit_nrules = 0;
+
+    cfg->probe_enable = 1;
+    strcpy(cfg->probe_uris,
+           "/generate_204,/gen_204,/hotspot-detect.html,"
+           "/library/test/success.html,/connecttest.txt,/ncsi.txt");
+
+    cfg->log_enable = 0;
+    strcpy(cfg->log_target, "file:/tmp/portal-signer-decisions.log");
+    strcpy(cfg->log_format, "text");
+    cfg->log_ring = 4096;
+
+    cfg->snapshot_enable = 1;
+    strcpy(cfg->snapshot_path, "/tmp/portal-signer.snap");
+    cfg->snapshot_interval = 60;
+
+    cfg->ctx_enable = 1;
+    cfg->ctx_clients = 4096;
+
+    cfg->ipset_enable = 0;
+    strcpy(cfg->ipset_guest, "portal_allow_guest");
+    strcpy(cfg->ipset_staff, "portal_allow_staff");
+    cfg->ipset_clients = 4096;
+    cfg->ipset_timeout = 0;
+    cfg->ipset_reconcile = 300;
+    cfg->ipset_batch = 256;
+    strcpy(cfg->access_key_file, "/etc/portal/portal.access.key");
+
+    cfg->batch_enable = 0;
+    strcpy(cfg->batch_path, "/portal/context/verify/batch");
+    cfg->batch_max = 32;
+    cfg->batch_window_us = 2000;
+
+    cfg->mem_budget_kb = 0;
+
+    cfg->capture_enable = 0;
+    strcpy(cfg->capture_path, "/tmp/portal-signer.cap");
+    cfg->capture_max_kb = 65536;
+
+    strcpy(cfg->io_backend, "poll");
+    cfg->io_uring_entries = 256;
+
+    cfg->bypass_enable = 1;
+    strcpy(cfg->bypass_env, "/tmp/portal-runtime.env");
 }
 
 /* --------------------------------------------------
@@ -57,6 +117,39 @@ static void parse_host_port(const char *s,
     *port = atoi(p + 1);
 }
 
+/* "rate/burst" (burst defaults to rate) */
+static void parse_rate_burst(const char *s, int *rate, int *burst)
+{
+    *rate = atoi(s);
+    const char *p = strchr(s, '/');
+    *burst = p ? atoi(p + 1) : *rate;
+}
+
+/* ratelimit.vlan.<id>=rate/burst | ratelimit.ssid.<ssid>=rate/burst */
+static void add_rl_rule(signer_config_t *cfg, const char *key, const char *val)
+{
+    if (cfg->ratelimit_nrules >= SIGNER_RL_MAX_RULES)
+        return;
+
+    signer_rl_rule_t *r = &cfg->ratelimit_rules[cfg->ratelimit_nrules];
+    memset(r, 0, sizeof(*r));
+
+    if (!strncmp(key, "ratelimit.vlan.", 15)) {
+        r->vlan_id = atoi(key + 15);
+        if (r->vlan_id <= 0)
+            return;
+    } else if (!strncmp(key, "ratelimit.ssid.", 15)) {
+        if (key[15] == '\0')
+            return;
+        strncpy(r->ssid, key + 15, sizeof(r->ssid) - 1);
+    } else {
+        return;
+    }
+
+    parse_rate_burst(val, &r->rate, &r->burst);
+    cfg->ratelimit_nrules++;
+}
+
 /* --------------------------------------------------
  * Load config file: key=value
  * -------------------------------------------------- */
@@ -96,9 +189,114 @@ int signer_config_load_file(signer_config_t *cfg, const char *path)
         } else if (!strcmp(key, "controller.path")) {
             strncpy(cfg->controller_path, val,
                     sizeof(cfg->controller_path) - 1);
+        } else if (!strcmp(key, "controller.endpoints")) {
+            strncpy(cfg->controller_endpoints, val,
+                    sizeof(cfg->controller_endpoints) - 1);
+        } else if (!strcmp(key, "controller.timeout_ms")) {
+            cfg->controller_timeout_ms = atoi(val);
+        } else if (!strcmp(key, "controller.eject_failures")) {
+            cfg->controller_eject_failures = atoi(val);
+        } else if (!strcmp(key, "controller.eject_ms")) {
+            cfg->controller_eject_ms = atoi(val);
+        } else if (!strcmp(key, "controller.health_path")) {
+            strncpy(cfg->controller_health_path, val,
+                    sizeof(cfg->controller_health_path) - 1);
+        } else if (!strcmp(key, "controller.health_interval")) {
+            cfg->controller_health_interval = atoi(val);
+        } else if (!strcmp(key, "controller.hedge")) {
+            cfg->controller_hedge = atoi(val);
+        } else if (!strcmp(key, "controller.hedge_min_ms")) {
+            cfg->controller_hedge_min_ms = atoi(val);
         } else if (!strcmp(key, "key.file")) {
             strncpy(cfg->key_file, val,
                     sizeof(cfg->key_file) - 1);
+        } else if (!strcmp(key, "sign.raw_max_kb")) {
+            cfg->sign_raw_max_kb = atoi(val);
+        } else if (!strcmp(key, "sign.raw_timeout_ms")) {
+            cfg->sign_raw_timeout_ms = atoi(val);
+        } else if (!strcmp(key, "ratelimit.enable")) {
+            cfg->ratelimit_enable = atoi(val);
+        } else if (!strcmp(key, "ratelimit.clients")) {
+            cfg->ratelimit_clients = atoi(val);
+        } else if (!strcmp(key, "ratelimit.rate")) {
+            cfg->ratelimit_rate = atoi(val);
+        } else if (!strcmp(key, "ratelimit.burst")) {
+            cfg->ratelimit_burst = atoi(val);
+        } else if (!strcmp(key, "ratelimit.verdict_ttl")) {
+            cfg->ratelimit_verdict_ttl = atoi(val);
+        } else if (!strcmp(key, "probe.enable")) {
+            cfg->probe_enable = atoi(val);
+        } else if (!strcmp(key, "probe.uris")) {
+            strncpy(cfg->probe_uris, val,
+                    sizeof(cfg->probe_uris) - 1);
+        } else if (!strcmp(key, "log.enable")) {
+            cfg->log_enable = atoi(val);
+        } else if (!strcmp(key, "log.target")) {
+            strncpy(cfg->log_target, val,
+                    sizeof(cfg->log_target) - 1);
+        } else if (!strcmp(key, "log.format")) {
+            strncpy(cfg->log_format, val,
+                    sizeof(cfg->log_format) - 1);
+        } else if (!strcmp(key, "log.ring")) {
+            cfg->log_ring = atoi(val);
+        } else if (!strcmp(key, "snapshot.enable")) {
+            cfg->snapshot_enable = atoi(val);
+        } else if (!strcmp(key, "snapshot.path")) {
+            strncpy(cfg->snapshot_path, val,
+                    sizeof(cfg->snapshot_path) - 1);
+        } else if (!strcmp(key, "snapshot.interval")) {
+            cfg->snapshot_interval = atoi(val);
+        } else if (!strcmp(key, "ctx.enable")) {
+            cfg->ctx_enable = atoi(val);
+        } else if (!strcmp(key, "ctx.clients")) {
+            cfg->ctx_clients = atoi(val);
+        } else if (!strcmp(key, "ipset.enable")) {
+            cfg->ipset_enable = atoi(val);
+        } else if (!strcmp(key, "ipset.guest")) {
+            strncpy(cfg->ipset_guest, val, sizeof(cfg->ipset_guest) - 1);
+        } else if (!strcmp(key, "ipset.staff")) {
+            strncpy(cfg->ipset_staff, val, sizeof(cfg->ipset_staff) - 1);
+        } else if (!strcmp(key, "ipset.clients")) {
+            cfg->ipset_clients = atoi(val);
+        } else if (!strcmp(key, "ipset.timeout")) {
+            cfg->ipset_timeout = atoi(val);
+        } else if (!strcmp(key, "ipset.reconcile")) {
+            cfg->ipset_reconcile = atoi(val);
+        } else if (!strcmp(key, "ipset.batch")) {
+            cfg->ipset_batch = atoi(val);
+        } else if (!strcmp(key, "access.key_file")) {
+            strncpy(cfg->access_key_file, val,
+                    sizeof(cfg->access_key_file) - 1);
+        } else if (!strcmp(key, "batch.enable")) {
+            cfg->batch_enable = atoi(val);
+        } else if (!strcmp(key, "batch.path")) {
+            strncpy(cfg->batch_path, val, sizeof(cfg->batch_path) - 1);
+        } else if (!strcmp(key, "batch.max")) {
+            cfg->batch_max = atoi(val);
+        } else if (!strcmp(key, "batch.window_us")) {
+            cfg->batch_window_us = atoi(val);
+        } else if (!strcmp(key, "mem.budget_kb")) {
+            cfg->mem_budget_kb = atoi(val);
+        } else if (!strcmp(key, "capture.enable")) {
+            cfg->capture_enable = atoi(val);
+        } else if (!strcmp(key, "capture.path")) {
+            strncpy(cfg->capture_path, val,
+                    sizeof(cfg->capture_path) - 1);
+        } else if (!strcmp(key, "capture.max_kb")) {
+            cfg->capture_max_kb = atoi(val);
+        } else if (!strcmp(key, "io.backend")) {
+            strncpy(cfg->io_backend, val,
+                    sizeof(cfg->io_backend) - 1);
+        } else if (!strcmp(key, "io.uring_entries")) {
+            cfg->io_uring_entries = atoi(val);
+        } else if (!strcmp(key, "bypass.enable")) {
+            cfg->bypass_enable = atoi(val);
+        } else if (!strcmp(key, "bypass.env")) {
+            strncpy(cfg->bypass_env, val,
+                    sizeof(cfg->bypass_env) - 1);
+        } else if (!strncmp(key, "ratelimit.vlan.", 15) ||
+                   !strncmp(key, "ratelimit.ssid.", 15)) {
+            add_rl_rule(cfg, key, val);
         }
         /* Unknown keys are silently ignored */
     }
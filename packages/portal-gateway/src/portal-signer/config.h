@@ -1,5 +1,15 @@
 #pragma once
 
+#define SIGNER_RL_MAX_RULES 16
+
+/* Rate-limit override for one VLAN or SSID (ssid[0] == '\0' → VLAN rule) */
+typedef struct {
+    int  vlan_id;
+    char ssid[33];
+    int  rate;
+    int  burst;
+} signer_rl_rule_t;
+
 /*
  * signer_config_t
  *
@@ -42,6 +52,28 @@
      */
     char controller_path[128];
 
+    /* --------------------------------------------------
+     * Controller pool (see controller.h)
+     *
+     * controller.endpoints=10.0.0.2:9090,10.0.0.3:9090
+     *                             empty = controller.addr:port
+     * controller.timeout_ms=2000  per verify, all attempts
+     * controller.eject_failures=3 consecutive failures to eject
+     * controller.eject_ms=5000    first backoff, doubles up to 60s
+     * controller.health_path=     GET for ejected endpoints, empty = off
+     * controller.health_interval=5
+     * controller.hedge=1          duplicate single verifies slower than p95
+     * controller.hedge_min_ms=5   never hedge earlier than this
+     * -------------------------------------------------- */
+    char controller_endpoints[256];
+    int  controller_timeout_ms;
+    int  controller_eject_failures;
+    int  controller_eject_ms;
+    char controller_health_path[128];
+    int  controller_health_interval;
+    int  controller_hedge;
+    int  controller_hedge_min_ms;
+
     /* --------------------------------------------------
      * Path to shared signing key file
      * Used for HMAC / signature generation
@@ -49,6 +81,192 @@
      * -------------------------------------------------- */
     char key_file[256];
 
+    /* --------------------------------------------------
+     * POST /sign/raw upload bounds
+     *
+     * sign.raw_max_kb=65536       body size limit, 0 = none
+     * sign.raw_timeout_ms=2000    whole body, 0 = none
+     *
+     * The body is hashed on a worker thread (a few at
+     * once, more get 503); larger uploads get 413, slower
+     * ones 408.
+     * -------------------------------------------------- */
+    int  sign_raw_max_kb;
+    int  sign_raw_timeout_ms;
+
+    /* --------------------------------------------------
+     * Per-client rate limiting (token bucket)
+     *
+     * ratelimit.enable=1
+     * ratelimit.clients=16384     table size, fixed at startup
+     * ratelimit.rate=5            tokens per second (0 = unlimited)
+     * ratelimit.burst=20
+     * ratelimit.verdict_ttl=30    seconds a verdict may answer
+     *                             over-limit requests locally
+     * ratelimit.vlan.<id>=rate/burst
+     * ratelimit.ssid.<ssid>=rate/burst
+     *
+     * SSID rules win over VLAN rules, which win over the default.
+     * -------------------------------------------------- */
+    int  ratelimit_enable;
+    int  ratelimit_clients;
+    int  ratelimit_rate;
+    int  ratelimit_burst;
+    int  ratelimit_verdict_ttl;
+
+    int  ratelimit_nrules;
+    signer_rl_rule_t ratelimit_rules[SIGNER_RL_MAX_RULES];
+
+    /* --------------------------------------------------
+     * OS connectivity probe fast path
+     *
+     * probe.enable=1
+     * probe.uris=/generate_204,/hotspot-detect.html,...
+     *
+     * Matching X-Original-URI paths skip signing and are
+     * answered from the local verdict cache when the client
+     * is known to be allowed (see ratelimit.verdict_ttl).
+     * -------------------------------------------------- */
+    int  probe_enable;
+    char probe_uris[512];
+
+    /* --------------------------------------------------
+     * Decision / audit log (async, see declog.h)
+     *
+     * log.enable=1
+     * log.target=file:/tmp/portal-signer-decisions.log
+     *            | syslog | unix:/var/run/portal-decisions.sock
+     * log.format=text | binary
+     * log.ring=4096               records, rounded to power of 2
+     *
+     * Started once at startup (not reloaded).
+     * -------------------------------------------------- */
+    int  log_enable;
+    char log_target[128];
+    char log_format[16];
+    int  log_ring;
+
+    /* --------------------------------------------------
+     * Warm restart snapshot of the client table
+     *
+     * snapshot.enable=1
+     * snapshot.path=/tmp/portal-signer.snap
+     * snapshot.interval=60        seconds, 0 = only on shutdown
+     * -------------------------------------------------- */
+    int  snapshot_enable;
+    char snapshot_path[256];
+    int  snapshot_interval;
+
+    /* --------------------------------------------------
+     * Live client context (netlink neighbour + nl80211)
+     *
+     * ctx.enable=1
+     * ctx.clients=4096            table size, fixed at startup
+     *
+     * Fills MAC / VLAN / radio / SSID from X-Client-IP when
+     * nginx did not provide them, and returns them as
+     * response headers (see portal-auth.conf).
+     * -------------------------------------------------- */
+    int  ctx_enable;
+    int  ctx_clients;
+
+    /* --------------------------------------------------
+     * Access ipsets programmed over netlink (see ipsetnl.h)
+     *
+     * ipset.enable=1
+     * ipset.guest=portal_allow_guest
+     * ipset.staff=portal_allow_staff
+     * ipset.clients=4096          grant table size, fixed at startup
+     * ipset.timeout=0             default grant lifetime (s), 0 = until revoked
+     * ipset.reconcile=300         full reconcile period (s), 0 = startup only
+     * ipset.batch=256             queued changes before a forced write
+     * access.key_file=/etc/portal/portal.access.key
+     *
+     * Grants / revokes arrive on POST /access, signed (v1) by
+     * the controller with access.key_file, and are written in
+     * multi-entry batches. The access key must differ from
+     * key.file, or /sign could mint grants. Started once (not
+     * reloaded).
+     * -------------------------------------------------- */
+    int  ipset_enable;
+    char ipset_guest[32];
+    char ipset_staff[32];
+    int  ipset_clients;
+    int  ipset_timeout;
+    int  ipset_reconcile;
+    int  ipset_batch;
+    char access_key_file[256];
+
+    /* --------------------------------------------------
+     * Controller micro-batching (see controller.h)
+     *
+     * batch.enable=1
+     * batch.path=/portal/context/verify/batch
+     * batch.max=32                items per controller call (2..256)
+     * batch.window_us=2000        longest wait for more items
+     *
+     * The actual window adapts to the arrival rate; under
+     * light load requests are verified one by one.
+     * -------------------------------------------------- */
+    int  batch_enable;
+    char batch_path[128];
+    int  batch_max;
+    int  batch_window_us;
+
+    /* --------------------------------------------------
+     * Memory budget (see mempool.h)
+     *
+     * mem.budget_kb=2048          per-request buffers, 0 = unbounded
+     *
+     * Connection state and request bodies are pre-allocated
+     * from the budget at startup (not reloaded); requests that
+     * do not fit get 503. Usage is on GET /status. Budgets
+     * below one connection + two bodies are raised (logged).
+     * -------------------------------------------------- */
+    int  mem_budget_kb;
+
+    /* --------------------------------------------------
+     * Request capture for portal-replay (see capture.h)
+     *
+     * capture.enable=1
+     * capture.path=/tmp/portal-signer.cap
+     * capture.max_kb=65536        trace size limit, 0 = none
+     *
+     * Records every verify-path request with its headers and
+     * outcome. Started once (not reloaded); the file is
+     * truncated at startup.
+     * -------------------------------------------------- */
+    int  capture_enable;
+    char capture_path[128];
+    int  capture_max_kb;
+
+    /* --------------------------------------------------
+     * Network I/O backend (see uring.h)
+     *
+     * io.backend=poll             poll | uring
+     * io.uring_entries=256        submission queue size
+     *
+     * uring accepts, receives and replies through io_uring;
+     * falls back to poll if the kernel lacks support.
+     * Chosen once at startup (not reloaded).
+     * -------------------------------------------------- */
+    char io_backend[8];
+    int  io_uring_entries;
+
+    /* --------------------------------------------------
+     * Walled-garden allow-list (see bypass.h)
+     *
+     * bypass.enable=1
+     * bypass.env=/tmp/portal-runtime.env
+     *
+     * BYPASS_DOMAINS / BYPASS_IPS written by portal-agent.sh;
+     * matching requests that nginx proxies to portal_server
+     * are allowed without a controller call. The file is
+     * re-read when it changes.
+     * -------------------------------------------------- */
+    int  bypass_enable;
+    char bypass_env[128];
+
 } signer_config_t;
 
 
@@ -0,0 +1,615 @@
+#include "controller.h"
+#include "mempool.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH_ITEM_MAX      1280        /* one item's JSON, incl. escaped URI */
+#define BATCH_WRAP_MAX      32          /* {"items":[ .. ]} */
+#define SINGLE_RESP_MAX     1024
+
+#define CTRL_MAX_ENDPOINTS  8
+#define CTRL_LAT_SAMPLES    256
+#define CTRL_P95_EVERY      32
+#define CTRL_EJECT_MAX_MS   60000u
+#define CTRL_HEALTH_MS      100
+
+typedef struct {
+    char               addr[64];
+    int                port;
+    struct sockaddr_in sa;
+    int                outstanding;
+    int                fails;           /* consecutive */
+    uint64_t           ejected_until;   /* monotonic ms, 0 = in rotation */
+    uint32_t           eject_ms;        /* current backoff */
+} ctrl_endpoint_t;
+
+/* One in-flight request to one endpoint */
+typedef struct {
+    int              fd;
+    ctrl_endpoint_t *ep;
+    int              sending;
+    size_t           off;               /* bytes of hdr + body written */
+    int              hlen;
+    char             hdr[512];
+    uint64_t         t0;
+} ctrl_attempt_t;
+
+static ctrl_endpoint_t g_eps[CTRL_MAX_ENDPOINTS];
+static int             g_neps;
+static unsigned int    g_rr;
+static char            g_spec[256];
+
+static uint32_t        g_lat[CTRL_LAT_SAMPLES];
+static unsigned int    g_lat_n;
+static uint32_t        g_p95_us;
+static uint64_t        g_next_health;
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static uint64_t mono_ms(void) {
+    return mono_us() / 1000u;
+}
+
+/* Escape `s` for a JSON string value (quotes, backslashes, control chars). */
+static void json_escape(char *out, size_t cap, const char *s) {
+    size_t o = 0;
+    for (; s && *s && o + 7 < cap; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c < 0x20) {
+            o += (size_t)snprintf(out + o, cap - o, "\\u%04x", c);
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o] = '\0';
+}
+
+static int format_item(char *out, size_t cap, const char *id_field,
+                       const char *method, const char *uri, const portal_sig_t *sig) {
+    char m[128], u[1024];
+    json_escape(m, sizeof(m), method);
+    json_escape(u, sizeof(u), uri);
+
+    return snprintf(out, cap,
+        "{"
+          "%s"
+          "\"method\":\"%s\","
+          "\"uri\":\"%s\","
+          "\"security\":{"
+            "\"kid\":\"%s\","
+            "\"timestamp\":\"%s\","
+            "\"nonce\":\"%s\","
+            "\"signature\":\"%s\""
+          "}"
+        "}",
+        id_field,
+        m,
+        u,
+        "v1",
+        sig->timestamp,
+        sig->nonce,
+        sig->signature
+    );
+}
+
+static int status_code(const char *resp) {
+    int code = 0;
+    if (sscanf(resp, "HTTP/%*s %d", &code) != 1) return 0;
+    return code;
+}
+
+/* --------------------------------------------------
+ * Endpoint pool
+ * -------------------------------------------------- */
+static void add_endpoint(const char *addr, int port) {
+    if (g_neps >= CTRL_MAX_ENDPOINTS) return;
+
+    ctrl_endpoint_t *ep = &g_eps[g_neps];
+    memset(ep, 0, sizeof(*ep));
+    snprintf(ep->addr, sizeof(ep->addr), "%s", addr);
+    ep->port = port;
+    ep->sa.sin_family = AF_INET;
+    ep->sa.sin_port = htons((uint16_t)port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, addr, &ep->sa.sin_addr) != 1) {
+        fprintf(stderr, "[portal-signer] controller: bad endpoint %s:%d\n", addr, port);
+        return;
+    }
+    g_neps++;
+}
+
+static void ep_ok(ctrl_endpoint_t *ep) {
+    if (ep->ejected_until)
+        fprintf(stderr, "[portal-signer] controller: %s:%d back in rotation\n",
+                ep->addr, ep->port);
+    ep->fails = 0;
+    ep->ejected_until = 0;
+    ep->eject_ms = 0;
+}
+
+/* Consecutive failures eject; failing again after the backoff doubles it. */
+static void ep_fail(const signer_config_t *cfg, ctrl_endpoint_t *ep) {
+    if (++ep->fails < cfg->controller_eject_failures) return;
+
+    uint64_t now = mono_ms();
+    if (ep->ejected_until > now) return;
+
+    uint32_t base = cfg->controller_eject_ms > 0 ? (uint32_t)cfg->controller_eject_ms : 1000u;
+    ep->eject_ms = ep->eject_ms ? ep->eject_ms * 2 : base;
+    if (ep->eject_ms > CTRL_EJECT_MAX_MS) ep->eject_ms = CTRL_EJECT_MAX_MS;
+    ep->ejected_until = now + ep->eject_ms;
+
+    fprintf(stderr, "[portal-signer] controller: %s:%d ejected for %ums (%d failures)\n",
+            ep->addr, ep->port, ep->eject_ms, ep->fails);
+}
+
+/*
+ * Least outstanding among endpoints in rotation (ties rotate).
+ * An ejected endpoint whose backoff has run out is in rotation again
+ * for one trial request. Only if the whole pool is ejected and
+ * `allow_ejected`, the one due back first is used rather than failing
+ * outright; while any endpoint is healthy (even one already tried),
+ * ejected ones are skipped.
+ */
+static ctrl_endpoint_t *pick_endpoint(unsigned int tried, int allow_ejected) {
+    uint64_t now = mono_ms();
+    ctrl_endpoint_t *best = NULL, *fallback = NULL;
+    int healthy = 0;
+
+    for (int k = 0; k < g_neps; k++) {
+        int i = (int)((g_rr + (unsigned int)k) % (unsigned int)g_neps);
+        ctrl_endpoint_t *ep = &g_eps[i];
+        int ejected = ep->ejected_until > now;
+        if (!ejected) healthy = 1;
+        if (tried & (1u << i)) continue;
+
+        if (ejected) {
+            if (!fallback || ep->ejected_until < fallback->ejected_until)
+                fallback = ep;
+            continue;
+        }
+        if (!best || ep->outstanding < best->outstanding)
+            best = ep;
+    }
+    g_rr++;
+    return best ? best : (allow_ejected && !healthy ? fallback : NULL);
+}
+
+static void record_latency(uint32_t us) {
+    g_lat[g_lat_n % CTRL_LAT_SAMPLES] = us;
+    g_lat_n++;
+    if (g_lat_n % CTRL_P95_EVERY) return;
+
+    uint32_t sorted[CTRL_LAT_SAMPLES];
+    unsigned int n = g_lat_n < CTRL_LAT_SAMPLES ? g_lat_n : CTRL_LAT_SAMPLES;
+    memcpy(sorted, g_lat, n * sizeof(sorted[0]));
+
+    /* insertion sort: n <= 256, every 32 samples */
+    for (unsigned int i = 1; i < n; i++) {
+        uint32_t v = sorted[i];
+        unsigned int j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    g_p95_us = sorted[(n * 95) / 100];
+}
+
+/* --------------------------------------------------
+ * Requests
+ * -------------------------------------------------- */
+static int attempt_start(ctrl_attempt_t *a, ctrl_endpoint_t *ep,
+                         const char *method, const char *path, int blen) {
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+    a->ep = ep;
+    a->t0 = mono_us();
+
+    a->hlen = snprintf(a->hdr, sizeof(a->hdr),
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "%s"
+        "Content-Length: %d\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        method, path, ep->addr, ep->port,
+        blen ? "Content-Type: application/json\r\n" : "",
+        blen);
+    if (a->hlen <= 0 || a->hlen >= (int)sizeof(a->hdr)) return -6;
+
+    a->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (a->fd < 0) return -3;
+
+    if (connect(a->fd, (struct sockaddr *)&ep->sa, sizeof(ep->sa)) != 0 &&
+        errno != EINPROGRESS) {
+        close(a->fd);
+        a->fd = -1;
+        return -5;
+    }
+    a->sending = 1;
+    ep->outstanding++;
+    return 0;
+}
+
+static void attempt_close(ctrl_attempt_t *a) {
+    if (a->fd >= 0) close(a->fd);
+    a->fd = -1;
+    if (a->ep) a->ep->outstanding--;
+    a->ep = NULL;
+}
+
+/* Returns 1 when fully written, 0 to wait for POLLOUT, < 0 on error. */
+static int attempt_send(ctrl_attempt_t *a, const char *body, int blen) {
+    size_t total = (size_t)a->hlen + (size_t)blen;
+    while (a->off < total) {
+        struct iovec iov[2];
+        int cnt = 0;
+        if (a->off < (size_t)a->hlen) {
+            iov[cnt].iov_base = a->hdr + a->off;
+            iov[cnt].iov_len = (size_t)a->hlen - a->off;
+            cnt++;
+        }
+        size_t boff = a->off > (size_t)a->hlen ? a->off - (size_t)a->hlen : 0;
+        if (blen) {
+            iov[cnt].iov_base = (char *)body + boff;
+            iov[cnt].iov_len = (size_t)blen - boff;
+            cnt++;
+        }
+
+        ssize_t w = writev(a->fd, iov, cnt);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -7;      /* includes a refused connect */
+        }
+        a->off += (size_t)w;
+    }
+    return 1;
+}
+
+/* Read the (Connection: close) response to EOF, bounded by `deadline`. */
+static int attempt_read(ctrl_attempt_t *a, char *resp, size_t cap, uint64_t deadline) {
+    size_t got = 0;
+    while (got + 1 < cap) {
+        ssize_t r = read(a->fd, resp + got, cap - 1 - got);
+        if (r > 0) {
+            got += (size_t)r;
+            continue;
+        }
+        if (r == 0) break;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+
+        uint64_t now = mono_us();
+        if (now >= deadline) break;
+        struct pollfd p = { .fd = a->fd, .events = POLLIN };
+        if (poll(&p, 1, (int)((deadline - now + 999) / 1000)) <= 0) break;
+    }
+    resp[got] = '\0';
+    return (int)got;
+}
+
+/*
+ * POST `body` to `path` on the pool. Transport errors, timeouts and 5xx
+ * count against the endpoint and fail over to the next one.
+ *
+ * With `hedge`, a request still unanswered after the observed p95 is
+ * duplicated to a second endpoint. Both copies carry the same nonce, so
+ * a controller with a shared replay cache may reject one of them: a 2xx
+ * wins at once, any other answer only once no attempt is left in flight.
+ *
+ * Returns the response length (resp holds status line, headers, body),
+ * or < 0 if no endpoint answered.
+ */
+static int controller_call(const signer_config_t *cfg, const char *path,
+                           const char *body, int blen, char *resp, size_t cap,
+                           int hedge) {
+    if (g_neps == 0) return -1;
+
+    uint64_t start = mono_us();
+    uint64_t deadline = start + (uint64_t)(cfg->controller_timeout_ms > 0 ?
+                                           cfg->controller_timeout_ms : 2000) * 1000u;
+    uint64_t hedge_at = 0;
+    if (hedge && cfg->controller_hedge && g_neps > 1 && g_lat_n >= CTRL_P95_EVERY) {
+        uint64_t after = g_p95_us;
+        uint64_t min_us = (uint64_t)(cfg->controller_hedge_min_ms > 0 ?
+                                     cfg->controller_hedge_min_ms : 0) * 1000u;
+        if (after < min_us) after = min_us;
+        hedge_at = start + after;
+    }
+
+    ctrl_attempt_t att[2];
+    int live = 0;
+    unsigned int tried = 0;
+    int rc = -1;
+    char held[SINGLE_RESP_MAX];         /* non-2xx answer waiting for the other attempt */
+    int held_n = 0;
+
+    for (;;) {
+        uint64_t now = mono_us();
+
+        if (live == 0 && held_n > 0)
+            break;
+
+        /* Start the first attempt, fail over, or hedge */
+        int want = live == 0 || (hedge_at && now >= hedge_at && live == 1);
+        if (want && now < deadline) {
+            ctrl_endpoint_t *ep = pick_endpoint(tried, live == 0);
+            if (ep) {
+                tried |= 1u << (ep - g_eps);
+                if (live == 1) hedge_at = 0;        /* one hedge per call */
+                if (attempt_start(&att[live], ep, "POST", path, blen) == 0)
+                    live++;
+                else
+                    ep_fail(cfg, ep);
+                continue;
+            }
+            hedge_at = 0;
+        }
+        if (live == 0 || now >= deadline) break;
+
+        uint64_t until = deadline;
+        if (hedge_at && hedge_at < until) until = hedge_at;
+
+        struct pollfd pfd[2];
+        for (int i = 0; i < live; i++) {
+            pfd[i].fd = att[i].fd;
+            pfd[i].events = att[i].sending ? POLLOUT : POLLIN;
+            pfd[i].revents = 0;
+        }
+        int r = poll(pfd, (nfds_t)live, (int)((until - now + 999) / 1000));
+        if (r < 0 && errno != EINTR) break;
+        if (r <= 0) continue;
+
+        for (int i = live - 1; i >= 0; i--) {
+            if (!pfd[i].revents) continue;
+            ctrl_attempt_t *a = &att[i];
+
+            int ok = 0, hold = 0;
+            if (a->sending) {
+                int s = attempt_send(a, body, blen);
+                if (s == 0) continue;
+                if (s == 1) {
+                    a->sending = 0;
+                    continue;
+                }
+            } else {
+                int n = attempt_read(a, resp, cap, deadline);
+                int code = n > 0 ? status_code(resp) : 0;
+                if (code >= 100 && code < 500) {
+                    /* hedged: a 4xx may be the other copy's nonce being replayed */
+                    if (live > 1 && (code < 200 || code >= 300) &&
+                        (size_t)n < sizeof(held)) {
+                        memcpy(held, resp, (size_t)n + 1);
+                        held_n = n;
+                        hold = 1;
+                    } else {
+                        ok = 1;
+                        rc = n;
+                    }
+                }
+            }
+
+            if (ok || hold) {
+                record_latency((uint32_t)(mono_us() - a->t0));
+                ep_ok(a->ep);
+            }
+            if (ok) {
+                for (int j = 0; j < live; j++)
+                    attempt_close(&att[j]);         /* hedge loser is abandoned */
+                return rc;
+            }
+
+            if (!hold)
+                ep_fail(cfg, a->ep);
+            attempt_close(a);
+            if (i != live - 1) att[i] = att[live - 1];
+            live--;
+        }
+    }
+
+    /* Timed out (or nothing left to try) */
+    for (int i = 0; i < live; i++) {
+        ep_fail(cfg, att[i].ep);
+        attempt_close(&att[i]);
+    }
+    if (held_n > 0) {
+        memcpy(resp, held, (size_t)held_n + 1);
+        return held_n;
+    }
+    return -1;
+}
+
+/* Active check of ejected endpoints: GET health_path, 2xx puts it back. */
+static void health_check(const signer_config_t *cfg, ctrl_endpoint_t *ep) {
+    ctrl_attempt_t a;
+    char resp[256];
+    uint64_t deadline = mono_us() + CTRL_HEALTH_MS * 1000u;
+
+    if (attempt_start(&a, ep, "GET", cfg->controller_health_path, 0) != 0)
+        return;
+
+    int code = 0;
+    while (mono_us() < deadline) {
+        struct pollfd p = { .fd = a.fd, .events = a.sending ? POLLOUT : POLLIN };
+        if (poll(&p, 1, (int)((deadline - mono_us() + 999) / 1000)) <= 0) break;
+        if (a.sending) {
+            int s = attempt_send(&a, NULL, 0);
+            if (s < 0) break;
+            if (s == 1) a.sending = 0;
+            continue;
+        }
+        if (attempt_read(&a, resp, sizeof(resp), deadline) > 0)
+            code = status_code(resp);
+        break;
+    }
+    attempt_close(&a);
+
+    if (code >= 200 && code < 300) ep_ok(ep);
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+void controller_configure(const signer_config_t *cfg) {
+    char spec[sizeof(g_spec)];
+    if (cfg->controller_endpoints[0])
+        snprintf(spec, sizeof(spec), "%s", cfg->controller_endpoints);
+    else
+        snprintf(spec, sizeof(spec), "%s:%d", cfg->controller_addr, cfg->controller_port);
+
+    /* Unchanged list keeps its health state across reloads */
+    if (g_neps && !strcmp(spec, g_spec)) return;
+    snprintf(g_spec, sizeof(g_spec), "%s", spec);
+    g_neps = 0;
+
+    char buf[sizeof(g_spec)];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+        char *colon = strrchr(tok, ':');
+        if (!colon) {
+            add_endpoint(tok, cfg->controller_port);
+            continue;
+        }
+        *colon = '\0';
+        add_endpoint(tok, atoi(colon + 1));
+    }
+
+    fprintf(stderr, "[portal-signer] controller: %d endpoint(s)%s\n",
+            g_neps, cfg->controller_hedge ? ", hedging at p95" : "");
+}
+
+void controller_tick(const signer_config_t *cfg) {
+    if (!cfg->controller_health_path[0] || cfg->controller_health_interval <= 0)
+        return;
+
+    uint64_t now = mono_ms();
+    if (now < g_next_health) return;
+    g_next_health = now + (uint64_t)cfg->controller_health_interval * 1000u;
+
+    for (int i = 0; i < g_neps; i++)
+        if (g_eps[i].ejected_until)
+            health_check(cfg, &g_eps[i]);
+}
+
+int controller_verify(const signer_config_t *cfg,
+                      const char *orig_method,
+                      const char *orig_uri,
+                      const portal_sig_t *sig) {
+    if (!cfg || cfg->controller_path[0] == '\0') {
+        return -1;
+    }
+
+    char body[BATCH_ITEM_MAX];
+    int blen = format_item(body, sizeof(body), "", orig_method, orig_uri, sig);
+    if (blen <= 0 || blen >= (int)sizeof(body)) return -2;
+
+    char resp[SINGLE_RESP_MAX];
+    if (controller_call(cfg, cfg->controller_path, body, blen, resp, sizeof(resp), 1) <= 0)
+        return -8;
+
+    /* HTTP/1.1 204 No Content */
+    int code = status_code(resp);
+    if (code >= 200 && code < 300) return 0;
+    return -10;
+}
+
+/* Parse {"results":[{"id":N,"status":S}, ...]} into allow[]. */
+static void parse_batch_results(const char *body, int n, int *allow) {
+    const char *p = body;
+    while ((p = strstr(p, "\"id\"")) != NULL) {
+        p += 4;
+        int id = -1, status = 0;
+        if (sscanf(p, " : %d", &id) != 1) continue;
+
+        const char *st = strstr(p, "\"status\"");
+        const char *next = strstr(p, "\"id\"");
+        if (!st || (next && next < st)) continue;
+        if (sscanf(st + 8, " : %d", &status) != 1) continue;
+
+        if (id >= 0 && id < n)
+            allow[id] = (status >= 200 && status < 300) ? 1 : 0;
+    }
+}
+
+int controller_batch_capacity(void) {
+    size_t bs = mempool_block_size(MEMPOOL_BODY);
+    if (bs <= BATCH_WRAP_MAX) return 0;
+    return (int)((bs - BATCH_WRAP_MAX) / BATCH_ITEM_MAX);
+}
+
+int controller_verify_batch(const signer_config_t *cfg,
+                            const controller_req_t *const *reqs, int n, int *allow) {
+    for (int i = 0; i < n; i++)
+        allow[i] = -1;
+    if (!cfg || n <= 0 || cfg->batch_path[0] == '\0') {
+        return -3;
+    }
+
+    /* Request and response each take one body block from the pool */
+    char *body = (char *)mempool_get(MEMPOOL_BODY);
+    char *resp = (char *)mempool_get(MEMPOOL_BODY);
+    if (!body || !resp) {
+        mempool_put(MEMPOOL_BODY, body);
+        mempool_put(MEMPOOL_BODY, resp);
+        return -3;
+    }
+    size_t cap = mempool_block_size(MEMPOOL_BODY);
+
+    /* Items that do not fit are left out and keep allow = -1 */
+    size_t end = cap - 3;               /* room for "]}" + NUL */
+    size_t off = (size_t)snprintf(body, cap, "{\"items\":[");
+    for (int i = 0; i < n; i++) {
+        char id_field[32];
+        snprintf(id_field, sizeof(id_field), "\"id\":%d,", i);
+        size_t sep = i ? 1 : 0;
+        if (off + sep >= end) break;
+        int w = format_item(body + off + sep, end - off - sep, id_field,
+                            reqs[i]->method, reqs[i]->uri, &reqs[i]->sig);
+        if (w <= 0 || (size_t)w >= end - off - sep) break;
+        if (sep) body[off] = ',';
+        off += sep + (size_t)w;
+    }
+    off += (size_t)snprintf(body + off, cap - off, "]}");
+
+    int rc = -1;
+    /* Not hedged: a replayed batch would come back 2xx with per-item 401s */
+    int got = controller_call(cfg, cfg->batch_path, body, (int)off, resp, (int)cap, 0);
+    mempool_put(MEMPOOL_BODY, body);
+
+    if (got > 0) {
+        int code = status_code(resp);
+        const char *hdr_end = strstr(resp, "\r\n\r\n");
+        if (code == 404 || code == 405) {
+            rc = -2;
+        } else if (code >= 200 && code < 300 && hdr_end) {
+            parse_batch_results(hdr_end + 4, n, allow);
+            rc = 0;
+        }
+    }
+
+    mempool_put(MEMPOOL_BODY, resp);
+    return rc;
+}
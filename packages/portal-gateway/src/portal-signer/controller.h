@@ -0,0 +1,52 @@
+#pragma once
+
+#include "config.h"
+#include "crypto_hmac.h"
+
+/*
+ * Controller verify client.
+ *
+ * Requests go to a pool of endpoints (controller.endpoints, or the single
+ * controller.addr:port): least outstanding first, failing endpoints are
+ * ejected with backoff and optionally health-checked back in, and a slow
+ * request can be hedged to a second endpoint after the observed p95.
+ *
+ * Single:  POST controller_path with one JSON request; 2xx = allow.
+ * Batch:   POST batch.path with
+ *            {"items":[{"id":0,"method":..,"uri":..,"security":{..}}, ..]}
+ *          and expects 2xx with
+ *            {"results":[{"id":0,"status":204}, {"id":1,"status":401}, ..]}
+ *          where each status follows the single-verify convention.
+ */
+
+/* (Re)build the endpoint pool; an unchanged list keeps its health state. */
+void controller_configure(const signer_config_t *cfg);
+
+/* Health-check ejected endpoints (controller.health_*); call periodically. */
+void controller_tick(const signer_config_t *cfg);
+
+typedef struct {
+    char         method[64];
+    char         uri[512];
+    portal_sig_t sig;
+} controller_req_t;
+
+/* Returns 0 on allow, < 0 on deny / error. */
+int controller_verify(const signer_config_t *cfg,
+                      const char *orig_method,
+                      const char *orig_uri,
+                      const portal_sig_t *sig);
+
+/*
+ * Verify n requests in one call. allow[i] is set to 1 (allow), 0 (deny)
+ * or -1 (no verdict in the response).
+ *
+ * Returns 0, -1 if the call failed as a whole (no answer, timeout, 5xx),
+ * -2 if the controller does not implement the batch path (404 / 405), or
+ * -3 if nothing was sent (no batch path configured, no buffers).
+ */
+int controller_verify_batch(const signer_config_t *cfg,
+                            const controller_req_t *const *reqs, int n, int *allow);
+
+/* Most items one batch call can carry (bounded by the mempool body block). */
+int controller_batch_capacity(void);
@@ -1,5 +1,6 @@
 #include "crypto_hmac.h"
 
+#include <openssl/crypto.h>
 #include <openssl/sha.h>
 #include <openssl/hmac.h>
 #include <openssl/evp.h>
@@ -19,6 +20,10 @@ static void bytes_to_hex_lower(const unsigned char *in, size_t in_len, char out_
     out_hex[in_len * 2] = '\0';
 }
 
+struct portal_body_hash {
+    EVP_MD_CTX *md;
+};
+
 static void sha256_hex_lower(const unsigned char *data, size_t len, char out_hex[65]) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
     if (!data) {
@@ -77,12 +82,8 @@ static char *build_canonical_v1(
     const char *method,
     const char *path,
     const char *raw_query,
-    const unsigned char *body,
-    size_t body_len
+    const char body_hash[65]
 ) {
-    char body_hash[65];
-    sha256_hex_lower(body, body_len, body_hash);
-
     if (!raw_query) raw_query = "";
 
     /* length of: each field + '\n', plus final '\0' */
@@ -149,38 +150,126 @@ static void split_uri(const char *uri, char *out_path, size_t out_path_sz, char
     snprintf(out_query, out_query_sz, "%s", q + 1);
 }
 
-int portal_sign_v1_hmac_sha256_base64(
+/* Signature of the canonical string for the timestamp / nonce in `sig` */
+static int mac_v1(
     const char *key_file,
+    const portal_sig_t *sig,
     const char *method,
     const char *path,
     const char *raw_query,
-    const unsigned char *body,
-    size_t body_len,
-    portal_sig_t *out_sig
+    const char body_hash[65],
+    char out_b64[128]
 ) {
-    if (!key_file || !method || !path || !out_sig) return -1;
-
     unsigned char *key = NULL;
     size_t key_len = 0;
     int rc = read_key_file(key_file, &key, &key_len);
     if (rc != 0) return -2;
 
-    gen_timestamp(out_sig->timestamp);
-    gen_nonce(out_sig->nonce);
-
-    char *canonical = build_canonical_v1(out_sig->timestamp, out_sig->nonce, method, path, raw_query, body, body_len);
+    char *canonical = build_canonical_v1(sig->timestamp, sig->nonce, method, path, raw_query, body_hash);
     if (!canonical) {
         free(key);
         return -3;
     }
 
-    rc = hmac_sha256_base64(key, key_len, canonical, out_sig->signature);
+    rc = hmac_sha256_base64(key, key_len, canonical, out_b64);
 
     free(canonical);
     free(key);
     return rc;
 }
 
+static int sign_v1(
+    const char *key_file,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    const char body_hash[65],
+    portal_sig_t *out_sig
+) {
+    if (!key_file || !method || !path || !out_sig) return -1;
+
+    gen_timestamp(out_sig->timestamp);
+    gen_nonce(out_sig->nonce);
+    return mac_v1(key_file, out_sig, method, path, raw_query, body_hash, out_sig->signature);
+}
+
+int portal_sign_v1_hmac_sha256_base64(
+    const char *key_file,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    const unsigned char *body,
+    size_t body_len,
+    portal_sig_t *out_sig
+) {
+    char body_hash[65];
+    sha256_hex_lower(body, body_len, body_hash);
+    return sign_v1(key_file, method, path, raw_query, body_hash, out_sig);
+}
+
+portal_body_hash_t *portal_body_hash_new(void) {
+    portal_body_hash_t *h = (portal_body_hash_t *)malloc(sizeof(*h));
+    if (!h) return NULL;
+
+    h->md = EVP_MD_CTX_new();
+    if (!h->md || EVP_DigestInit_ex(h->md, EVP_sha256(), NULL) != 1) {
+        portal_body_hash_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+int portal_body_hash_update(portal_body_hash_t *h, const void *data, size_t len) {
+    return EVP_DigestUpdate(h->md, data, len) == 1 ? 0 : -1;
+}
+
+void portal_body_hash_free(portal_body_hash_t *h) {
+    if (!h) return;
+    EVP_MD_CTX_free(h->md);
+    free(h);
+}
+
+int portal_sign_v1_hmac_sha256_base64_stream(
+    const char *key_file,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    portal_body_hash_t *h,
+    portal_sig_t *out_sig
+) {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_len = 0;
+    if (!h || EVP_DigestFinal_ex(h->md, hash, &hash_len) != 1 ||
+        hash_len != SHA256_DIGEST_LENGTH)
+        return -1;
+
+    char body_hash[65];
+    bytes_to_hex_lower(hash, hash_len, body_hash);
+    return sign_v1(key_file, method, path, raw_query, body_hash, out_sig);
+}
+
+int portal_verify_v1_hmac_sha256_base64(
+    const char *key_file,
+    const portal_sig_t *sig,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    const unsigned char *body,
+    size_t body_len
+) {
+    if (!key_file || !sig || !method || !path) return -2;
+
+    char body_hash[65];
+    char want[128];
+    sha256_hex_lower(body, body_len, body_hash);
+    if (mac_v1(key_file, sig, method, path, raw_query, body_hash, want) != 0)
+        return -2;
+
+    size_t n = strlen(want);
+    if (strlen(sig->signature) != n) return -1;
+    return CRYPTO_memcmp(want, sig->signature, n) == 0 ? 0 : -1;
+}
+
 int portal_sign_v0_hmac_sha256(
     const char *key_file,
     const char *method,
@@ -46,6 +46,48 @@ int portal_sign_v1_hmac_sha256_base64(
     portal_sig_t *out_sig
 );
 
+/**
+ * Incremental SHA-256 of a request body, for bodies that are signed as
+ * they stream in instead of being held in memory (POST /sign/raw).
+ */
+typedef struct portal_body_hash portal_body_hash_t;
+
+portal_body_hash_t *portal_body_hash_new(void);
+int  portal_body_hash_update(portal_body_hash_t *h, const void *data, size_t len);
+void portal_body_hash_free(portal_body_hash_t *h);
+
+/**
+ * Same as portal_sign_v1_hmac_sha256_base64(), with sha256_hex(body)
+ * taken from `h`. `h` is finalised and can only be freed afterwards.
+ *
+ * Returns 0 on success.
+ */
+int portal_sign_v1_hmac_sha256_base64_stream(
+    const char *key_file,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    portal_body_hash_t *h,
+    portal_sig_t *out_sig
+);
+
+/**
+ * Check a v1 signature made by a peer: `sig` carries the timestamp,
+ * nonce and signature as received. The comparison is constant-time;
+ * freshness and replay are up to the caller.
+ *
+ * Returns 0 if it matches, -1 if not, -2 if the key cannot be read.
+ */
+int portal_verify_v1_hmac_sha256_base64(
+    const char *key_file,
+    const portal_sig_t *sig,
+    const char *method,
+    const char *path,
+    const char *raw_query,
+    const unsigned char *body,
+    size_t body_len
+);
+
 /**
  * v0 legacy API kept for compatibility with existing code.
  * It is implemented as v1 with:
@@ -0,0 +1,378 @@
+#include "declog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DECLOG_BATCH     64
+#define DECLOG_LINE_MAX  320
+#define DECLOG_IDLE_NS   (20 * 1000 * 1000)    /* writer poll interval */
+
+_Static_assert(sizeof(declog_record_t) == 88, "declog_record_t layout changed");
+
+typedef enum {
+    SINK_FILE = 1,
+    SINK_SYSLOG,
+    SINK_UNIX,
+} sink_kind_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    declog_record_t  rec;
+} declog_slot_t;
+
+static declog_slot_t    *g_ring;
+static uint32_t          g_mask;
+static _Atomic uint32_t  g_head;        /* next slot to claim (producers) */
+static uint32_t          g_tail;        /* next slot to drain (writer only) */
+static _Atomic uint64_t  g_dropped;
+
+static pthread_t         g_thread;
+static _Atomic int       g_running;
+
+static sink_kind_t       g_sink;
+static int               g_binary;
+static int               g_fd = -1;
+static char              g_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/* --------------------------------------------------
+ * Ring (Vyukov-style bounded queue, single consumer)
+ * -------------------------------------------------- */
+int declog_push(const declog_record_t *rec) {
+    if (!g_ring) return -1;
+
+    uint32_t pos = atomic_load_explicit(&g_head, memory_order_relaxed);
+    declog_slot_t *s;
+
+    for (;;) {
+        s = &g_ring[pos & g_mask];
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Full: count, never wait */
+            atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&g_head, memory_order_relaxed);
+        }
+    }
+
+    s->rec = *rec;
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static int ring_pop(declog_record_t *out) {
+    declog_slot_t *s = &g_ring[g_tail & g_mask];
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+
+    if ((int32_t)(seq - (g_tail + 1)) < 0)
+        return 0;
+
+    *out = s->rec;
+    atomic_store_explicit(&s->seq, g_tail + g_mask + 1, memory_order_release);
+    g_tail++;
+    return 1;
+}
+
+/* --------------------------------------------------
+ * Formatting / sinks
+ * -------------------------------------------------- */
+static const char *verdict_str(uint8_t v) {
+    switch (v) {
+        case DECLOG_VERDICT_ALLOW:   return "allow";
+        case DECLOG_VERDICT_DENY:    return "deny";
+        case DECLOG_VERDICT_LIMITED: return "limited";
+        default:                     return "error";
+    }
+}
+
+static const char *source_str(uint8_t s) {
+    switch (s) {
+        case DECLOG_SRC_CONTROLLER: return "controller";
+        case DECLOG_SRC_PROBE:      return "probe";
+        case DECLOG_SRC_RATELIMIT:  return "ratelimit";
+        case DECLOG_SRC_BYPASS:     return "bypass";
+        default:                    return "local";
+    }
+}
+
+/* Same shape as nginx portal_main: "$remote_addr [$time_local] key=\"value\" ..." */
+static int format_text(const declog_record_t *r, char *buf, size_t cap) {
+    time_t sec = (time_t)(r->ts_ms / 1000);
+    struct tm tm;
+    char tbuf[40];
+    localtime_r(&sec, &tm);
+    strftime(tbuf, sizeof(tbuf), "%d/%b/%Y:%H:%M:%S %z", &tm);
+
+    int n = snprintf(buf, cap,
+        "%s [%s] "
+        "method=\"%.8s\" "
+        "uri_hash=\"%08x\" "
+        "auth=\"%s\" "
+        "source=\"%s\" "
+        "status=\"%u\" "
+        "vlan=\"%u\" "
+        "mac=\"%02x:%02x:%02x:%02x:%02x:%02x\" "
+        "parse_us=\"%u\" sign_us=\"%u\" ctrl_us=\"%u\" total_us=\"%u\"\n",
+        r->ip[0] ? r->ip : "-", tbuf,
+        r->method,
+        r->uri_hash,
+        verdict_str(r->verdict),
+        source_str(r->source),
+        r->status,
+        r->vlan_id,
+        r->mac[0], r->mac[1], r->mac[2], r->mac[3], r->mac[4], r->mac[5],
+        r->parse_us, r->sign_us, r->ctrl_us, r->total_us);
+
+    if (n < 0) return 0;
+    return n >= (int)cap ? (int)cap - 1 : n;
+}
+
+static int sink_open(const signer_config_t *cfg) {
+    const char *t = cfg->log_target;
+
+    g_binary = !strcmp(cfg->log_format, "binary");
+
+    if (!strcmp(t, "syslog")) {
+        g_sink = SINK_SYSLOG;
+        g_binary = 0;   /* syslog is line oriented */
+        openlog("portal-signer", 0, LOG_DAEMON);
+        return 0;
+    }
+
+    if (!strncmp(t, "unix:", 5)) {
+        g_sink = SINK_UNIX;
+        if (snprintf(g_path, sizeof(g_path), "%s", t + 5) >= (int)sizeof(g_path)) {
+            fprintf(stderr, "[portal-signer] declog: socket path too long\n");
+            return -1;
+        }
+
+        g_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (g_fd < 0) return -1;
+
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        memcpy(sa.sun_path, g_path, sizeof(sa.sun_path));
+        /* A missing listener is not fatal; sends are retried per batch */
+        (void)connect(g_fd, (struct sockaddr *)&sa, sizeof(sa));
+        return 0;
+    }
+
+    g_sink = SINK_FILE;
+    if (snprintf(g_path, sizeof(g_path), "%s",
+                 !strncmp(t, "file:", 5) ? t + 5 : t) >= (int)sizeof(g_path)) {
+        fprintf(stderr, "[portal-signer] declog: log path too long\n");
+        return -1;
+    }
+    g_fd = open(g_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    return g_fd < 0 ? -1 : 0;
+}
+
+static void sink_close(void) {
+    if (g_sink == SINK_SYSLOG)
+        closelog();
+    if (g_fd >= 0)
+        close(g_fd);
+    g_fd = -1;
+}
+
+static void sink_reconnect_unix(void) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, g_path, sizeof(sa.sun_path));
+    (void)connect(g_fd, (struct sockaddr *)&sa, sizeof(sa));
+}
+
+static void sink_write_batch(const declog_record_t *recs, int n) {
+    if (n <= 0) return;
+
+    if (g_sink == SINK_SYSLOG) {
+        char line[DECLOG_LINE_MAX];
+        for (int i = 0; i < n; i++) {
+            int len = format_text(&recs[i], line, sizeof(line));
+            if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+            syslog(LOG_INFO, "%s", line);
+        }
+        return;
+    }
+
+    if (g_fd < 0) return;
+
+    if (g_sink == SINK_UNIX) {
+        /* One datagram per record so readers never see partial lines */
+        char line[DECLOG_LINE_MAX];
+        for (int i = 0; i < n; i++) {
+            const void *p = &recs[i];
+            size_t len = sizeof(recs[i]);
+            if (!g_binary) {
+                len = (size_t)format_text(&recs[i], line, sizeof(line));
+                p = line;
+            }
+            if (send(g_fd, p, len, MSG_DONTWAIT) < 0 &&
+                (errno == ENOTCONN || errno == ECONNREFUSED || errno == ENOENT)) {
+                sink_reconnect_unix();
+                return;     /* listener gone: drop this batch */
+            }
+        }
+        return;
+    }
+
+    /* File: one write() per batch */
+    if (g_binary) {
+        (void)write(g_fd, recs, sizeof(recs[0]) * (size_t)n);
+        return;
+    }
+
+    char buf[DECLOG_BATCH * DECLOG_LINE_MAX];
+    size_t off = 0;
+    for (int i = 0; i < n; i++)
+        off += (size_t)format_text(&recs[i], buf + off, sizeof(buf) - off);
+    (void)write(g_fd, buf, off);
+}
+
+/* --------------------------------------------------
+ * Writer thread
+ * -------------------------------------------------- */
+static int drain_once(void) {
+    declog_record_t batch[DECLOG_BATCH];
+    int n = 0;
+
+    while (n < DECLOG_BATCH && ring_pop(&batch[n]))
+        n++;
+
+    sink_write_batch(batch, n);
+    return n;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    uint64_t reported = 0;
+
+    while (atomic_load(&g_running)) {
+        if (drain_once() == DECLOG_BATCH)
+            continue;
+
+        uint64_t d = atomic_load_explicit(&g_dropped, memory_order_relaxed);
+        if (d != reported) {
+            fprintf(stderr, "[portal-signer] declog: %llu records dropped (ring full)\n",
+                    (unsigned long long)d);
+            reported = d;
+        }
+
+        struct timespec ts = { 0, DECLOG_IDLE_NS };
+        nanosleep(&ts, NULL);
+    }
+
+    while (drain_once() > 0)
+        ;
+    return NULL;
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int declog_enabled(void) {
+    return g_ring != NULL;
+}
+
+uint64_t declog_dropped(void) {
+    return atomic_load_explicit(&g_dropped, memory_order_relaxed);
+}
+
+void declog_fill(declog_record_t *rec, const portal_client_t *cli,
+                 const char *method, const char *uri) {
+    memset(rec, 0, sizeof(*rec));
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->ts_ms = (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+
+    if (cli) {
+        /* a cut address is worse than none */
+        if (snprintf(rec->ip, sizeof(rec->ip), "%s", cli->ip) >= (int)sizeof(rec->ip))
+            rec->ip[0] = '\0';
+        unsigned int m[6];
+        if (sscanf(cli->mac, "%x:%x:%x:%x:%x:%x",
+                   &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) == 6) {
+            for (int i = 0; i < 6; i++)
+                rec->mac[i] = (uint8_t)m[i];
+        }
+        rec->vlan_id = (uint16_t)cli->vlan_id;
+    }
+
+    if (method)
+        memcpy(rec->method, method, strnlen(method, sizeof(rec->method)));
+
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)(uri ? uri : ""); *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    rec->uri_hash = h;
+}
+
+int declog_start(const signer_config_t *cfg) {
+    if (!cfg->log_enable)
+        return 0;
+
+    uint32_t size = 64;
+    while (size < (uint32_t)cfg->log_ring && size < (1u << 20))
+        size <<= 1;
+
+    g_ring = (declog_slot_t *)calloc(size, sizeof(*g_ring));
+    if (!g_ring) return -1;
+    g_mask = size - 1;
+    for (uint32_t i = 0; i < size; i++)
+        atomic_init(&g_ring[i].seq, i);
+    atomic_init(&g_head, 0);
+    g_tail = 0;
+
+    if (sink_open(cfg) != 0) {
+        fprintf(stderr, "[portal-signer] declog: cannot open %s\n", cfg->log_target);
+        sink_close();
+        free(g_ring);
+        g_ring = NULL;
+        return -1;
+    }
+
+    atomic_store(&g_running, 1);
+    if (pthread_create(&g_thread, NULL, writer_main, NULL) != 0) {
+        atomic_store(&g_running, 0);
+        sink_close();
+        free(g_ring);
+        g_ring = NULL;
+        return -1;
+    }
+
+    fprintf(stderr, "[portal-signer] declog: %u slots -> %s (%s)\n",
+            size, cfg->log_target, g_binary ? "binary" : "text");
+    return 0;
+}
+
+void declog_stop(void) {
+    if (!g_ring) return;
+
+    atomic_store(&g_running, 0);
+    pthread_join(g_thread, NULL);
+    sink_close();
+
+    free(g_ring);
+    g_ring = NULL;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "config.h"
+#include "signer.h"
+
+/*
+ * Asynchronous decision / audit log.
+ *
+ * The request path pushes fixed-size binary records into a bounded
+ * lock-free MPSC ring (per-slot sequence numbers, CAS on the producer
+ * index). A background thread drains the ring in batches and writes
+ * them to a file, syslog or a UNIX datagram socket, either as
+ * key="value" text lines (same field style as nginx portal_main) or
+ * as the raw records.
+ *
+ * Producers never block: when the ring is full the record is counted
+ * as dropped and the drop total is reported by the writer thread.
+ */
+
+typedef enum {
+    DECLOG_VERDICT_ALLOW = 1,
+    DECLOG_VERDICT_DENY,
+    DECLOG_VERDICT_LIMITED,     /* over rate limit, no cached verdict */
+    DECLOG_VERDICT_ERROR,
+} declog_verdict_t;
+
+typedef enum {
+    DECLOG_SRC_CONTROLLER = 1,  /* controller_verify() round trip */
+    DECLOG_SRC_PROBE,           /* probe fast path, cached allow */
+    DECLOG_SRC_RATELIMIT,       /* over limit, answered locally */
+    DECLOG_SRC_LOCAL,           /* other local decision */
+    DECLOG_SRC_BYPASS,          /* walled-garden allow-list */
+} declog_source_t;
+
+/* On-wire layout of the binary format; 88 bytes, host byte order. */
+typedef struct {
+    uint64_t ts_ms;             /* wall clock, unix ms */
+    char     ip[40];
+    uint8_t  mac[6];
+    uint16_t vlan_id;
+    char     method[8];
+    uint32_t uri_hash;          /* FNV-1a of X-Original-URI */
+    uint8_t  verdict;           /* declog_verdict_t */
+    uint8_t  source;            /* declog_source_t */
+    uint16_t status;            /* HTTP status returned to nginx */
+    uint32_t parse_us;          /* accept → headers parsed */
+    uint32_t sign_us;           /* v1 signing */
+    uint32_t ctrl_us;           /* controller round trip */
+    uint32_t total_us;
+} declog_record_t;
+
+/* Start the writer thread. Returns 0 on success (or if disabled). */
+int  declog_start(const signer_config_t *cfg);
+
+/* Flush what is queued and stop the writer thread. */
+void declog_stop(void);
+
+/* 1 if records are being accepted. */
+int  declog_enabled(void);
+
+/* Zero `rec` and fill its timestamp and client / request fields. */
+void declog_fill(declog_record_t *rec, const portal_client_t *cli,
+                 const char *method, const char *uri);
+
+/* Enqueue a record; never blocks. Returns 0, or -1 if dropped. */
+int  declog_push(const declog_record_t *rec);
+
+/* Records dropped because the ring was full. */
+uint64_t declog_dropped(void);
@@ -0,0 +1,498 @@
+#include "ipsetnl.h"
+#include "nl.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/ipset/ip_set.h>
+
+#define IPSET_MSG_BUF     16384
+#define IPSET_RETRY_SEC   5
+
+#define ENT_USED          0x01
+#define ENT_SEEN          0x02      /* present in the kernel (reconcile) */
+
+/* Accepted by both protocol 6 and 7 kernels for ADD/DEL/LIST */
+#define IPSET_PROTO       IPSET_PROTOCOL_MIN
+
+typedef struct {
+    uint8_t  flags;
+    uint8_t  role;
+    uint8_t  mac[6];
+    uint32_t expires;       /* monotonic seconds, 0 = until revoked */
+} ipset_entry_t;
+
+typedef struct {
+    uint8_t  mac[6];
+    uint8_t  role;
+    uint8_t  del;
+    uint32_t timeout;       /* seconds for ADD, 0 = permanent */
+} ipset_op_t;
+
+static ipset_entry_t *g_tab;        /* open addressing, linear probing */
+static uint32_t       g_mask;
+static uint32_t       g_count;
+static uint32_t       g_limit;
+
+static ipset_op_t    *g_ops;
+static int            g_nops;
+static int            g_ops_cap;
+
+static char           g_sets[IPSETNL_ROLES][IPSET_MAXNAMELEN];
+static int            g_timeout_ok[IPSETNL_ROLES];
+static int            g_adopted[IPSETNL_ROLES];
+static unsigned int   g_default_ttl;
+static unsigned int   g_reconcile;
+static uint32_t       g_last_tick;
+static uint32_t       g_next_reconcile;
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static uint32_t mono_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec;
+}
+
+static uint32_t fnv32(const void *p, size_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= b[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int parse_mac(const char *s, uint8_t mac[6]) {
+    unsigned int m[6];
+    char tail;
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x%c", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &tail) != 6)
+        return -1;
+    for (int i = 0; i < 6; i++) {
+        if (m[i] > 0xff) return -1;
+        mac[i] = (uint8_t)m[i];
+    }
+    return 0;
+}
+
+/* --------------------------------------------------
+ * Desired-state table
+ * -------------------------------------------------- */
+static uint32_t home_of(const uint8_t mac[6]) {
+    return fnv32(mac, 6) & g_mask;
+}
+
+static ipset_entry_t *tab_find(const uint8_t mac[6]) {
+    for (uint32_t i = home_of(mac);; i = (i + 1) & g_mask) {
+        ipset_entry_t *e = &g_tab[i];
+        if (!(e->flags & ENT_USED)) return NULL;
+        if (!memcmp(e->mac, mac, 6)) return e;
+    }
+}
+
+/* Capacity is at least twice the limit, so probing always ends */
+static ipset_entry_t *tab_insert(const uint8_t mac[6], int role) {
+    if (g_count >= g_limit) return NULL;
+
+    uint32_t i = home_of(mac);
+    while (g_tab[i].flags & ENT_USED)
+        i = (i + 1) & g_mask;
+
+    ipset_entry_t *e = &g_tab[i];
+    e->flags = ENT_USED;
+    e->role = (uint8_t)role;
+    memcpy(e->mac, mac, 6);
+    e->expires = 0;
+    g_count++;
+    return e;
+}
+
+/* Backward-shift delete: keeps probe chains intact without tombstones */
+static void tab_remove(ipset_entry_t *e) {
+    uint32_t hole = (uint32_t)(e - g_tab);
+    uint32_t j = hole;
+
+    for (;;) {
+        j = (j + 1) & g_mask;
+        if (!(g_tab[j].flags & ENT_USED)) break;
+
+        uint32_t home = home_of(g_tab[j].mac);
+        if (((j - home) & g_mask) >= ((j - hole) & g_mask)) {
+            g_tab[hole] = g_tab[j];
+            hole = j;
+        }
+    }
+    memset(&g_tab[hole], 0, sizeof(g_tab[hole]));
+    g_count--;
+}
+
+static uint32_t remaining(const ipset_entry_t *e, uint32_t now) {
+    if (!e->expires) return 0;
+    return e->expires > now ? e->expires - now : 1;
+}
+
+/* --------------------------------------------------
+ * Kernel batches
+ * -------------------------------------------------- */
+static struct nlmsghdr *msg_begin(char *buf, int cmd, uint16_t flags, int role) {
+    struct nlmsghdr *n = nl_msg_init(buf, IPSET_MSG_BUF,
+                                     (uint16_t)((NFNL_SUBSYS_IPSET << 8) | cmd),
+                                     flags, sizeof(struct nfgenmsg));
+    struct nfgenmsg *g = (struct nfgenmsg *)nl_msg_data(n);
+    g->nfgen_family = AF_UNSPEC;
+    g->version = NFNETLINK_V0;
+    g->res_id = 0;
+
+    nl_put_u8(n, IPSET_MSG_BUF, IPSET_ATTR_PROTOCOL, IPSET_PROTO);
+    nl_put_str(n, IPSET_MSG_BUF, IPSET_ATTR_SETNAME, g_sets[role]);
+    return n;
+}
+
+/* One IPSET_ATTR_DATA element; rolled back if the buffer is full. */
+static int msg_put_entry(struct nlmsghdr *n, const ipset_op_t *op, int with_timeout) {
+    uint32_t mark = n->nlmsg_len;
+
+    struct nlattr *d = nl_nest_start(n, IPSET_MSG_BUF, IPSET_ATTR_DATA);
+    if (!d ||
+        nl_put(n, IPSET_MSG_BUF, IPSET_ATTR_ETHER, op->mac, 6) != 0 ||
+        (with_timeout &&
+         nl_put_u32(n, IPSET_MSG_BUF, IPSET_ATTR_TIMEOUT | NLA_F_NET_BYTEORDER,
+                    htonl(op->timeout)) != 0)) {
+        n->nlmsg_len = mark;
+        return -1;
+    }
+    nl_nest_end(n, d);
+    return 0;
+}
+
+/*
+ * Send all queued ops of one (set, command) as few multi-entry messages
+ * as fit. Without NLM_F_EXCL the kernel treats "already there" on ADD and
+ * "not there" on DEL as success, and refreshes timeouts on re-ADD.
+ */
+static int flush_group(int role, int del) {
+    char buf[IPSET_MSG_BUF];
+    int rc = 0;
+    int i = 0;
+
+    while (i < g_nops) {
+        int with_timeout = !del && g_timeout_ok[role];
+        struct nlmsghdr *n = msg_begin(buf, del ? IPSET_CMD_DEL : IPSET_CMD_ADD,
+                                       NLM_F_ACK, role);
+        nl_put_u32(n, IPSET_MSG_BUF, IPSET_ATTR_LINENO, 0);    /* required with ADT */
+        struct nlattr *adt = nl_nest_start(n, IPSET_MSG_BUF, IPSET_ATTR_ADT);
+
+        int start = i;
+        int count = 0;
+        for (; i < g_nops; i++) {
+            const ipset_op_t *op = &g_ops[i];
+            if (op->role != role || op->del != del) continue;
+            if (msg_put_entry(n, op, with_timeout) != 0) break;
+            count++;
+        }
+        if (!count) break;
+        nl_nest_end(n, adt);
+
+        int r = nl_transact(NETLINK_NETFILTER, n, NULL, NULL);
+        if (r == -IPSET_ERR_TIMEOUT && with_timeout) {
+            fprintf(stderr, "[portal-signer] ipset: %s has no timeout support, "
+                            "expiring grants locally\n", g_sets[role]);
+            g_timeout_ok[role] = 0;
+            i = start;
+            continue;
+        }
+        if (r != 0) {
+            fprintf(stderr, "[portal-signer] ipset: %s %s (%d entries) failed: %d\n",
+                    del ? "del" : "add", g_sets[role], count, r);
+            if (!rc) rc = r;
+        }
+    }
+    return rc;
+}
+
+/* Later ops on the same MAC and set replace earlier ones. */
+static void queue_op(const uint8_t mac[6], int role, int del, uint32_t timeout) {
+    for (int i = 0; i < g_nops; i++) {
+        if (g_ops[i].role == role && !memcmp(g_ops[i].mac, mac, 6)) {
+            g_ops[i].del = (uint8_t)del;
+            g_ops[i].timeout = timeout;
+            return;
+        }
+    }
+
+    if (g_nops == g_ops_cap)
+        (void)ipsetnl_flush();
+
+    ipset_op_t *op = &g_ops[g_nops++];
+    memcpy(op->mac, mac, 6);
+    op->role = (uint8_t)role;
+    op->del = (uint8_t)del;
+    op->timeout = timeout;
+}
+
+/* --------------------------------------------------
+ * Reconcile
+ * -------------------------------------------------- */
+typedef struct {
+    int      role;
+    int      adopt;
+    uint32_t now;
+    int      members;
+} list_ctx_t;
+
+static void member_seen(list_ctx_t *lc, const uint8_t mac[6], uint32_t left) {
+    lc->members++;
+
+    ipset_entry_t *e = tab_find(mac);
+    if (!e && lc->adopt) {
+        e = tab_insert(mac, lc->role);
+        if (!e) return;                 /* table full: leave it alone */
+        e->expires = left ? lc->now + left : 0;
+    }
+    if (!e) return;                     /* added by someone else: not ours to remove */
+
+    if (e->role == lc->role) {
+        e->flags |= ENT_SEEN;
+        return;
+    }
+    queue_op(mac, lc->role, 1, 0);      /* granted here under the other role */
+}
+
+static void on_list_msg(const struct nlmsghdr *n, void *arg) {
+    list_ctx_t *lc = (list_ctx_t *)arg;
+    if (n->nlmsg_type != ((NFNL_SUBSYS_IPSET << 8) | IPSET_CMD_LIST))
+        return;
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct nfgenmsg)))
+        return;
+
+    const struct nlattr *tb[IPSET_ATTR_CMD_MAX + 1];
+    nl_parse((const char *)NLMSG_DATA(n) + NLMSG_ALIGN(sizeof(struct nfgenmsg)),
+             n->nlmsg_len - NLMSG_LENGTH(sizeof(struct nfgenmsg)), tb, IPSET_ATTR_CMD_MAX);
+    if (!tb[IPSET_ATTR_ADT]) return;
+
+    /* Nested list of IPSET_ATTR_DATA { ETHER, [TIMEOUT] } */
+    const char *p = (const char *)nl_data(tb[IPSET_ATTR_ADT]);
+    size_t len = nl_len(tb[IPSET_ATTR_ADT]);
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr *el = (const struct nlattr *)p;
+        if (el->nla_len < NLA_HDRLEN || el->nla_len > len) break;
+
+        const struct nlattr *ad[IPSET_ATTR_ADT_MAX + 1];
+        nl_parse(nl_data(el), nl_len(el), ad, IPSET_ATTR_ADT_MAX);
+        if (ad[IPSET_ATTR_ETHER] && nl_len(ad[IPSET_ATTR_ETHER]) == 6) {
+            uint32_t left = ad[IPSET_ATTR_TIMEOUT] ? ntohl(nl_get_u32(ad[IPSET_ATTR_TIMEOUT])) : 0;
+            member_seen(lc, (const uint8_t *)nl_data(ad[IPSET_ATTR_ETHER]), left);
+        }
+
+        size_t step = NLA_ALIGN(el->nla_len);
+        if (step >= len) break;
+        p += step;
+        len -= step;
+    }
+}
+
+static int list_set(int role, uint32_t now, int *members) {
+    char buf[IPSET_MSG_BUF];
+    struct nlmsghdr *n = msg_begin(buf, IPSET_CMD_LIST, NLM_F_DUMP, role);
+
+    list_ctx_t lc = { role, !g_adopted[role], now, 0 };
+    int rc = nl_transact(NETLINK_NETFILTER, n, on_list_msg, &lc);
+    if (rc != 0) {
+        fprintf(stderr, "[portal-signer] ipset: cannot list %s: %d\n", g_sets[role], rc);
+        return rc;
+    }
+    g_adopted[role] = 1;
+    *members = lc.members;
+    return 0;
+}
+
+/* Dump both sets and queue whatever makes the kernel match the table. */
+static void reconcile(void) {
+    uint32_t now = mono_sec();
+    (void)ipsetnl_flush();
+
+    for (uint32_t i = 0; i <= g_mask; i++)
+        g_tab[i].flags &= (uint8_t)~ENT_SEEN;
+
+    int listed[IPSETNL_ROLES];
+    int members[IPSETNL_ROLES] = {0};
+    for (int r = 0; r < IPSETNL_ROLES; r++)
+        listed[r] = list_set(r, now, &members[r]) == 0;
+
+    int stale = g_nops;
+    int missing = 0;
+    for (uint32_t i = 0; i <= g_mask; i++) {
+        const ipset_entry_t *e = &g_tab[i];
+        if (!(e->flags & ENT_USED) || (e->flags & ENT_SEEN) || !listed[e->role])
+            continue;
+        if (e->expires && e->expires <= now)
+            continue;                   /* ipsetnl_tick() revokes it */
+        queue_op(e->mac, e->role, 0, remaining(e, now));
+        missing++;
+    }
+
+    if (stale || missing)
+        fprintf(stderr, "[portal-signer] ipset: reconcile %s=%d %s=%d members, "
+                        "%d stale, %d missing\n",
+                g_sets[0], members[0], g_sets[1], members[1], stale, missing);
+
+    if (ipsetnl_flush() != 0)
+        g_next_reconcile = now + IPSET_RETRY_SEC;
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int ipsetnl_enabled(void) { return g_tab != NULL; }
+int ipsetnl_pending(void) { return g_nops; }
+
+int ipsetnl_role_parse(const char *s, ipsetnl_role_t *out) {
+    if (!strcmp(s, "guest")) { *out = IPSETNL_ROLE_GUEST; return 0; }
+    if (!strcmp(s, "staff")) { *out = IPSETNL_ROLE_STAFF; return 0; }
+    return -1;
+}
+
+int ipsetnl_grant(const char *mac_s, ipsetnl_role_t role, unsigned int ttl) {
+    uint8_t mac[6];
+    if (!g_tab || role >= IPSETNL_ROLES || parse_mac(mac_s, mac) != 0)
+        return -1;
+    if (!ttl) ttl = g_default_ttl;
+
+    ipset_entry_t *e = tab_find(mac);
+    if (!e) {
+        e = tab_insert(mac, role);
+        if (!e) return -1;
+    } else if (e->role != role) {
+        queue_op(mac, e->role, 1, 0);   /* role change: leave the old set */
+        e->role = (uint8_t)role;
+    }
+
+    e->expires = ttl ? mono_sec() + ttl : 0;
+    queue_op(mac, role, 0, ttl);
+    return 0;
+}
+
+int ipsetnl_revoke(const char *mac_s) {
+    uint8_t mac[6];
+    if (!g_tab || parse_mac(mac_s, mac) != 0)
+        return -1;
+
+    ipset_entry_t *e = tab_find(mac);
+    if (e) {
+        queue_op(mac, e->role, 1, 0);
+        tab_remove(e);
+        return 0;
+    }
+
+    /* Unknown here: make sure neither set still admits it */
+    for (int r = 0; r < IPSETNL_ROLES; r++)
+        queue_op(mac, r, 1, 0);
+    return 0;
+}
+
+int ipsetnl_flush(void) {
+    if (!g_nops) return 0;
+
+    int rc = 0;
+    for (int r = 0; r < IPSETNL_ROLES; r++) {
+        /* Adds first: a role change briefly overlaps rather than gaps */
+        int a = flush_group(r, 0);
+        if (a && !rc) rc = a;
+    }
+    for (int r = 0; r < IPSETNL_ROLES; r++) {
+        int d = flush_group(r, 1);
+        if (d && !rc) rc = d;
+    }
+    g_nops = 0;
+
+    /* Whatever did not apply is repaired by an early reconcile */
+    if (rc) {
+        uint32_t retry = mono_sec() + IPSET_RETRY_SEC;
+        if (!g_next_reconcile || retry < g_next_reconcile)
+            g_next_reconcile = retry;
+    }
+    return rc;
+}
+
+void ipsetnl_tick(void) {
+    if (!g_tab) return;
+
+    uint32_t now = mono_sec();
+    if (now == g_last_tick) return;
+    g_last_tick = now;
+
+    for (uint32_t i = 0; i <= g_mask; ) {
+        ipset_entry_t *e = &g_tab[i];
+        if ((e->flags & ENT_USED) && e->expires && e->expires <= now) {
+            queue_op(e->mac, e->role, 1, 0);
+            tab_remove(e);
+            continue;                   /* slot i may now hold a shifted entry */
+        }
+        i++;
+    }
+
+    if (g_next_reconcile && now >= g_next_reconcile) {
+        g_next_reconcile = g_reconcile ? now + g_reconcile : 0;
+        reconcile();
+    }
+}
+
+int ipsetnl_start(const signer_config_t *cfg) {
+    ipsetnl_stop();
+    if (!cfg->ipset_enable) return 0;
+
+    g_limit = cfg->ipset_clients > 0 ? (uint32_t)cfg->ipset_clients : 1;
+    if (g_limit > (1u << 20)) g_limit = 1u << 20;
+
+    uint32_t cap = 2;
+    while (cap < 2 * g_limit) cap <<= 1;
+
+    g_ops_cap = cfg->ipset_batch > 0 ? cfg->ipset_batch : 1;
+    g_tab = (ipset_entry_t *)calloc(cap, sizeof(*g_tab));
+    g_ops = (ipset_op_t *)calloc((size_t)g_ops_cap, sizeof(*g_ops));
+    if (!g_tab || !g_ops) {
+        ipsetnl_stop();
+        return -1;
+    }
+    g_mask = cap - 1;
+
+    snprintf(g_sets[IPSETNL_ROLE_GUEST], IPSET_MAXNAMELEN, "%s", cfg->ipset_guest);
+    snprintf(g_sets[IPSETNL_ROLE_STAFF], IPSET_MAXNAMELEN, "%s", cfg->ipset_staff);
+    for (int r = 0; r < IPSETNL_ROLES; r++) {
+        g_timeout_ok[r] = 1;
+        g_adopted[r] = 0;
+    }
+    g_default_ttl = cfg->ipset_timeout > 0 ? (unsigned int)cfg->ipset_timeout : 0;
+    g_reconcile = cfg->ipset_reconcile > 0 ? (unsigned int)cfg->ipset_reconcile : 0;
+
+    /* Initial reconcile adopts current members */
+    reconcile();
+    if (g_reconcile && !g_next_reconcile)
+        g_next_reconcile = mono_sec() + g_reconcile;
+
+    fprintf(stderr, "[portal-signer] ipset: %s/%s, %u clients, %u adopted\n",
+            g_sets[IPSETNL_ROLE_GUEST], g_sets[IPSETNL_ROLE_STAFF], g_limit, g_count);
+    return 0;
+}
+
+void ipsetnl_stop(void) {
+    free(g_tab);
+    free(g_ops);
+    g_tab = NULL;
+    g_ops = NULL;
+    g_nops = 0;
+    g_ops_cap = 0;
+    g_count = 0;
+    g_mask = 0;
+    g_next_reconcile = 0;
+    g_last_tick = 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "config.h"
+
+/*
+ * Client access programmer for the portal_allow_* hash:mac ipsets.
+ *
+ * Grants and revokes are recorded in a desired-state table and queued;
+ * the queue is written to the kernel over NFNL ipset netlink as one
+ * IPSET_CMD_ADD / IPSET_CMD_DEL message per set carrying many entries
+ * (IPSET_ATTR_ADT), instead of one `ipset` fork per change.
+ *
+ * Entries may carry a lifetime. It is passed to the kernel as a
+ * per-entry timeout when the set supports it (portal-fw.sh creates the
+ * role sets with "timeout 0") and enforced by ipsetnl_tick() either way.
+ *
+ * ipsetnl_tick() also runs a periodic full reconcile: both sets are
+ * dumped and diffed against the table. The first reconcile after start
+ * adopts existing members, so a restart does not cut anyone off. Later
+ * reconciles only repair entries in the table (missing, or in the wrong
+ * set); members added by anything else are left alone.
+ *
+ * Fed by POST /access, which the controller calls through nginx
+ * (/__portal_access) or portal-agent.sh --access; requests are signed
+ * with access.key_file (see ipset.* in portal-signer.conf).
+ *
+ * Single-threaded (main loop only).
+ */
+
+typedef enum {
+    IPSETNL_ROLE_GUEST = 0,
+    IPSETNL_ROLE_STAFF = 1,
+    IPSETNL_ROLES
+} ipsetnl_role_t;
+
+/* Allocate the table and adopt current set members. Returns 0 (also if disabled). */
+int  ipsetnl_start(const signer_config_t *cfg);
+void ipsetnl_stop(void);
+int  ipsetnl_enabled(void);
+
+/* "guest" / "staff" -> role. Returns 0 or -1. */
+int  ipsetnl_role_parse(const char *s, ipsetnl_role_t *out);
+
+/*
+ * Queue a grant (ttl seconds, 0 = ipset.timeout default, which may itself
+ * be 0 = until revoked) or a revoke for an "aa:bb:cc:dd:ee:ff" MAC.
+ * Returns 0, or -1 on a bad MAC / full table.
+ */
+int  ipsetnl_grant(const char *mac, ipsetnl_role_t role, unsigned int ttl);
+int  ipsetnl_revoke(const char *mac);
+
+/* Number of queued kernel operations. */
+int  ipsetnl_pending(void);
+
+/* Write queued operations. Returns 0 or -errno of the first failed batch. */
+int  ipsetnl_flush(void);
+
+/* Expire grants and run the periodic reconcile; call at least once a second. */
+void ipsetnl_tick(void);
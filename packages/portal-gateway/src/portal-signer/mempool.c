@@ -0,0 +1,156 @@
+#include "mempool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MEMPOOL_ALIGN       64
+#define MEMPOOL_MAX_BODIES  16
+
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+typedef struct {
+    size_t        size;         /* block size, rounded to MEMPOOL_ALIGN */
+    char         *arena;        /* NULL when unbounded */
+    free_block_t *free;
+} pool_class_t;
+
+static pool_class_t    g_cls[MEMPOOL_CLASSES];
+static mempool_stats_t g_st;
+
+static size_t round_up(size_t n) {
+    return (n + MEMPOOL_ALIGN - 1) & ~(size_t)(MEMPOOL_ALIGN - 1);
+}
+
+static int class_alloc(pool_class_t *c, unsigned int count) {
+    c->arena = (char *)aligned_alloc(MEMPOOL_ALIGN, c->size * count);
+    if (!c->arena) return -1;
+
+    /* Touch every page now so RSS does not grow under load */
+    memset(c->arena, 0, c->size * count);
+
+    c->free = NULL;
+    for (unsigned int i = count; i > 0; i--) {
+        free_block_t *b = (free_block_t *)(c->arena + (size_t)(i - 1) * c->size);
+        b->next = c->free;
+        c->free = b;
+    }
+    return 0;
+}
+
+int mempool_init(size_t budget, size_t conn_size, size_t body_size) {
+    mempool_shutdown();
+
+    g_cls[MEMPOOL_CONN].size = round_up(conn_size);
+    g_cls[MEMPOOL_BODY].size = round_up(body_size);
+    g_st.budget = budget;
+    if (!budget) return 0;
+
+    /*
+     * A quarter of the budget for bodies (at least two: a controller
+     * batch call holds one for the request and one for the response),
+     * the rest for connections. A budget below that is raised to it.
+     */
+    size_t cs = g_cls[MEMPOOL_CONN].size;
+    size_t bs = g_cls[MEMPOOL_BODY].size;
+
+    unsigned int nb = (unsigned int)(budget / 4 / bs);
+    if (nb < 2) nb = 2;
+    if (nb > MEMPOOL_MAX_BODIES) nb = MEMPOOL_MAX_BODIES;
+
+    size_t left = budget > nb * bs ? budget - nb * bs : 0;
+    unsigned int nc = (unsigned int)(left / cs);
+    if (nc < 1) nc = 1;
+
+    if (class_alloc(&g_cls[MEMPOOL_CONN], nc) != 0 ||
+        class_alloc(&g_cls[MEMPOOL_BODY], nb) != 0) {
+        mempool_shutdown();
+        return -1;
+    }
+
+    g_st.blocks[MEMPOOL_CONN] = nc;
+    g_st.blocks[MEMPOOL_BODY] = nb;
+    g_st.reserved = nc * cs + nb * bs;
+
+    fprintf(stderr, "[portal-signer] mempool: budget %zu KiB -> %u conns x %zu B, "
+                    "%u bodies x %zu B (%zu KiB reserved)\n",
+            budget / 1024, nc, cs, nb, bs, g_st.reserved / 1024);
+    if (g_st.reserved > budget)
+        fprintf(stderr, "[portal-signer] mempool: mem.budget_kb=%zu is below the minimum "
+                        "of one connection and two bodies, using %zu KiB\n",
+                budget / 1024, g_st.reserved / 1024);
+    return 0;
+}
+
+void mempool_shutdown(void) {
+    for (int i = 0; i < MEMPOOL_CLASSES; i++) {
+        free(g_cls[i].arena);
+        g_cls[i].arena = NULL;
+        g_cls[i].free = NULL;
+    }
+    memset(&g_st, 0, sizeof(g_st));
+}
+
+void *mempool_get(mempool_class_t c) {
+    pool_class_t *pc = &g_cls[c];
+    void *p;
+
+    if (pc->arena) {
+        if (!pc->free) {
+            g_st.rejected[c]++;
+            return NULL;
+        }
+        p = pc->free;
+        pc->free = pc->free->next;
+    } else {
+        p = malloc(pc->size);
+        if (!p) {
+            g_st.rejected[c]++;
+            return NULL;
+        }
+    }
+
+    g_st.used[c]++;
+    g_st.in_use += pc->size;
+    if (g_st.in_use > g_st.peak) g_st.peak = g_st.in_use;
+    return p;
+}
+
+void mempool_put(mempool_class_t c, void *p) {
+    if (!p) return;
+    pool_class_t *pc = &g_cls[c];
+
+    g_st.used[c]--;
+    g_st.in_use -= pc->size;
+
+    if (pc->arena) {
+        free_block_t *b = (free_block_t *)p;
+        b->next = pc->free;
+        pc->free = b;
+    } else {
+        free(p);
+    }
+}
+
+size_t mempool_block_size(mempool_class_t c) {
+    return g_cls[c].size;
+}
+
+void mempool_stats(mempool_stats_t *out) {
+    *out = g_st;
+}
+
+long mempool_rss_kb(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+
+    long size = 0, resident = 0;
+    int ok = fscanf(f, "%ld %ld", &size, &resident) == 2;
+    fclose(f);
+    if (!ok) return -1;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
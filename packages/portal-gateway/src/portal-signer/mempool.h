@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Per-request buffer pool (mem.budget_kb).
+ *
+ * Two block classes:
+ *   MEMPOOL_CONN  per admitted connection (parse + parked verify state)
+ *   MEMPOOL_BODY  request bodies and controller batch buffers
+ *
+ * With a budget, all blocks are allocated and touched once at startup
+ * and handed out from free lists; mempool_get() returns NULL when a
+ * class is exhausted, which callers turn into a 503. Without a budget
+ * blocks come from malloc() and are only accounted.
+ *
+ * Single-threaded (main loop only).
+ */
+
+typedef enum {
+    MEMPOOL_CONN = 0,
+    MEMPOOL_BODY = 1,
+    MEMPOOL_CLASSES
+} mempool_class_t;
+
+typedef struct {
+    size_t        budget;                       /* bytes, 0 = unbounded */
+    size_t        reserved;                     /* pre-allocated bytes */
+    size_t        in_use;
+    size_t        peak;
+    unsigned int  blocks[MEMPOOL_CLASSES];      /* 0 when unbounded */
+    unsigned int  used[MEMPOOL_CLASSES];
+    unsigned long rejected[MEMPOOL_CLASSES];
+} mempool_stats_t;
+
+/* Size the pool from `budget` bytes (0 = unbounded). Returns 0 or -1. */
+int    mempool_init(size_t budget, size_t conn_size, size_t body_size);
+void   mempool_shutdown(void);
+
+void  *mempool_get(mempool_class_t c);
+void   mempool_put(mempool_class_t c, void *p);
+size_t mempool_block_size(mempool_class_t c);
+
+void   mempool_stats(mempool_stats_t *out);
+
+/* Resident set size of the process in KiB (from /proc/self/statm). */
+long   mempool_rss_kb(void);
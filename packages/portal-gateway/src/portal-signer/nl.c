@@ -0,0 +1,181 @@
+#include "nl.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define NL_RECV_BUF   16384
+
+struct nlmsghdr *nl_msg_init(void *buf, size_t cap, uint16_t type,
+                             uint16_t flags, size_t extra) {
+    size_t len = NLMSG_LENGTH(extra);
+    if (len > cap) return NULL;
+
+    memset(buf, 0, len);
+    struct nlmsghdr *n = (struct nlmsghdr *)buf;
+    n->nlmsg_len = (uint32_t)NLMSG_ALIGN(len);
+    n->nlmsg_type = type;
+    n->nlmsg_flags = flags;
+    return n;
+}
+
+int nl_put(struct nlmsghdr *n, size_t cap, uint16_t type,
+           const void *data, size_t len) {
+    size_t off = NLMSG_ALIGN(n->nlmsg_len);
+    size_t alen = NLA_HDRLEN + len;
+    if (off + NLA_ALIGN(alen) > cap) return -1;
+
+    struct nlattr *a = (struct nlattr *)((char *)n + off);
+    a->nla_type = type;
+    a->nla_len = (uint16_t)alen;
+    if (len) memcpy((char *)a + NLA_HDRLEN, data, len);
+    memset((char *)a + alen, 0, NLA_ALIGN(alen) - alen);
+
+    n->nlmsg_len = (uint32_t)(off + NLA_ALIGN(alen));
+    return 0;
+}
+
+int nl_put_u8(struct nlmsghdr *n, size_t cap, uint16_t type, uint8_t v) {
+    return nl_put(n, cap, type, &v, sizeof(v));
+}
+
+int nl_put_u32(struct nlmsghdr *n, size_t cap, uint16_t type, uint32_t v) {
+    return nl_put(n, cap, type, &v, sizeof(v));
+}
+
+int nl_put_str(struct nlmsghdr *n, size_t cap, uint16_t type, const char *s) {
+    return nl_put(n, cap, type, s, strlen(s) + 1);
+}
+
+struct nlattr *nl_nest_start(struct nlmsghdr *n, size_t cap, uint16_t type) {
+    struct nlattr *a = (struct nlattr *)((char *)n + NLMSG_ALIGN(n->nlmsg_len));
+    if (nl_put(n, cap, type | NLA_F_NESTED, NULL, 0) != 0) return NULL;
+    return a;
+}
+
+void nl_nest_end(struct nlmsghdr *n, struct nlattr *nest) {
+    nest->nla_len = (uint16_t)((char *)n + n->nlmsg_len - (char *)nest);
+}
+
+void nl_parse(const void *start, size_t len, const struct nlattr **tb, int max) {
+    memset(tb, 0, sizeof(*tb) * (size_t)(max + 1));
+
+    const char *p = (const char *)start;
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr *a = (const struct nlattr *)p;
+        if (a->nla_len < NLA_HDRLEN || a->nla_len > len) break;
+
+        int type = a->nla_type & NLA_TYPE_MASK;
+        if (type <= max) tb[type] = a;
+
+        size_t step = NLA_ALIGN(a->nla_len);
+        if (step >= len) break;
+        p += step;
+        len -= step;
+    }
+}
+
+int nl_open(int proto, uint32_t groups, int nonblock) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | (nonblock ? SOCK_NONBLOCK : 0), proto);
+    if (fd < 0) return -1;
+
+    /* Event bursts (mass reassociation) should not overflow the socket */
+    int rcvbuf = 256 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = groups;
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int nl_send(int fd, struct nlmsghdr *n) {
+    static uint32_t seq;
+
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+
+    n->nlmsg_seq = ++seq;
+    n->nlmsg_flags |= NLM_F_REQUEST;
+
+    ssize_t r = sendto(fd, n, n->nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa));
+    if (r < 0) return -errno;
+    return r == (ssize_t)n->nlmsg_len ? 0 : -EIO;
+}
+
+/* Walk one datagram. Returns 1 when the reply is complete, -errno on
+ * NLMSG_ERROR, 0 if more is expected. */
+static int dispatch(const char *buf, size_t len, nl_msg_cb cb, void *arg) {
+    for (const struct nlmsghdr *n = (const struct nlmsghdr *)buf;
+         NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+        if (n->nlmsg_type == NLMSG_DONE)
+            return 1;
+        if (n->nlmsg_type == NLMSG_ERROR) {
+            const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(n);
+            return e->error ? e->error : 1;     /* error 0 == ACK */
+        }
+        if (cb) cb(n, arg);
+        if (!(n->nlmsg_flags & NLM_F_MULTI))
+            return 1;
+    }
+    return 0;
+}
+
+int nl_drain(int fd, nl_msg_cb cb, void *arg) {
+    char buf[NL_RECV_BUF];
+    int lost = 0;
+
+    for (;;) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                lost = 1;
+                continue;
+            }
+            break;      /* EAGAIN: drained */
+        }
+        if (r == 0) break;
+
+        /* Every message, including the DONE / ERROR that ends a dump */
+        size_t len = (size_t)r;
+        for (const struct nlmsghdr *n = (const struct nlmsghdr *)buf;
+             NLMSG_OK(n, len); n = NLMSG_NEXT(n, len))
+            cb(n, arg);
+    }
+    return lost ? -ENOBUFS : 0;
+}
+
+int nl_transact(int proto, struct nlmsghdr *req, nl_msg_cb cb, void *arg) {
+    int fd = nl_open(proto, 0, 0);
+    if (fd < 0) return -errno;
+
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    int rc = nl_send(fd, req);
+    char buf[NL_RECV_BUF];
+
+    while (rc == 0) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            rc = -errno;
+            break;
+        }
+        int d = dispatch(buf, (size_t)r, cb, arg);
+        if (d == 1) break;
+        if (d < 0) rc = d;
+    }
+
+    close(fd);
+    return rc;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+
+/*
+ * Minimal raw netlink helpers (no libnl dependency).
+ *
+ * Messages are built in caller-provided buffers; attributes use the
+ * generic struct nlattr layout, which rtnetlink's struct rtattr shares.
+ */
+
+/* Start a message of `type` with `extra` zeroed bytes of family header. */
+struct nlmsghdr *nl_msg_init(void *buf, size_t cap, uint16_t type,
+                             uint16_t flags, size_t extra);
+
+/* Pointer to the family header following the nlmsghdr. */
+static inline void *nl_msg_data(const struct nlmsghdr *n) {
+    return (char *)n + NLMSG_HDRLEN;
+}
+
+/* Append an attribute. Returns 0, or -1 if it does not fit in `cap`. */
+int nl_put(struct nlmsghdr *n, size_t cap, uint16_t type,
+           const void *data, size_t len);
+int nl_put_u8(struct nlmsghdr *n, size_t cap, uint16_t type, uint8_t v);
+int nl_put_u32(struct nlmsghdr *n, size_t cap, uint16_t type, uint32_t v);
+int nl_put_str(struct nlmsghdr *n, size_t cap, uint16_t type, const char *s);
+
+/* Nested attributes: start returns the nest header, end fixes its length. */
+struct nlattr *nl_nest_start(struct nlmsghdr *n, size_t cap, uint16_t type);
+void nl_nest_end(struct nlmsghdr *n, struct nlattr *nest);
+
+/* Index attributes in [start, start+len) by type (tb[0..max]). */
+void nl_parse(const void *start, size_t len, const struct nlattr **tb, int max);
+
+static inline const void *nl_data(const struct nlattr *a) {
+    return (const char *)a + NLA_HDRLEN;
+}
+static inline size_t nl_len(const struct nlattr *a) {
+    return a->nla_len > NLA_HDRLEN ? (size_t)a->nla_len - NLA_HDRLEN : 0;
+}
+static inline uint32_t nl_get_u32(const struct nlattr *a) {
+    return nl_len(a) >= 4 ? *(const uint32_t *)nl_data(a) : 0;
+}
+
+/* Open a netlink socket subscribed to `groups` (legacy bitmask). */
+int nl_open(int proto, uint32_t groups, int nonblock);
+
+/* Send one message to the kernel. Returns 0 or -errno. */
+int nl_send(int fd, struct nlmsghdr *n);
+
+typedef void (*nl_msg_cb)(const struct nlmsghdr *n, void *arg);
+
+/* Drain a non-blocking socket, calling cb for every message (events and
+ * the replies to requests sent with nl_send(), NLMSG_DONE / NLMSG_ERROR
+ * included). Returns 0, or -ENOBUFS if the kernel dropped events. */
+int  nl_drain(int fd, nl_msg_cb cb, void *arg);
+
+/*
+ * Synchronous request/response (including dumps) on a private socket.
+ * cb sees every reply message. Returns 0, or -errno from NLMSG_ERROR /
+ * the socket layer.
+ */
+int nl_transact(int proto, struct nlmsghdr *req, nl_msg_cb cb, void *arg);
@@ -0,0 +1,400 @@
+/*
+ * portal-ctxmap: client context maps for nginx (CLIENT_CTX_SOURCE=maps).
+ *
+ * Replaces the `ip neigh` / `iw station dump` / awk pipelines of
+ * portal-agent.sh: neighbours and stations are read in one netlink pass
+ * (clientctx.c), sorted, and rendered into the same map blocks the
+ * script used to write. The output is deterministic, so the installed
+ * file is only replaced - and nginx only needs a reload - when a client
+ * actually came or went.
+ *
+ * map_hash_max_size / map_hash_bucket_size go to a separate file (-s):
+ * nginx fixes them at the first map block it parses, so they must be
+ * included before portal-auth.conf.
+ *
+ * Exit status: 0 a file was replaced, 1 unchanged, 2 error.
+ */
+#include "clientctx.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CTXMAP_CHANGED      0
+#define CTXMAP_UNCHANGED    1
+#define CTXMAP_ERROR        2
+
+#define MAP_HASH_MAX_MIN    2048        /* nginx defaults */
+#define MAP_HASH_BUCKET_MIN 64
+
+typedef struct {
+    char  *p;
+    size_t len;
+    size_t cap;
+    int    oom;
+} outbuf_t;
+
+typedef struct {
+    clientctx_neigh_row_t *v;
+    size_t n, cap;
+    const char *filter;                 /* captive interfaces, NULL = all */
+} neigh_list_t;
+
+typedef struct {
+    clientctx_sta_row_t *v;
+    size_t n, cap;
+    const char *filter;                 /* radios, NULL = all */
+} sta_list_t;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s -o maps.conf [-s hash.conf] [-a ap_id] [-i \"captive ifs\"]\n"
+            "          [-w \"radios\"] [-n max_clients] [-f]\n"
+            "  -o FILE   client context maps\n"
+            "  -s FILE   map_hash_* sizing (include before other map blocks)\n"
+            "  -a ID     value of $portal_ap_id\n"
+            "  -i LIST   only neighbours on these interfaces\n"
+            "  -w LIST   only stations on these radios\n"
+            "  -n N      table size (default 4096)\n"
+            "  -f        write even if unchanged\n"
+            "exit: 0 written, 1 unchanged, 2 error\n", prog);
+}
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static void out_printf(outbuf_t *b, const char *fmt, ...) {
+    if (b->oom) return;
+
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->p ? b->p + b->len : NULL, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            b->oom = 1;
+            return;
+        }
+        if ((size_t)n < b->cap - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+
+        size_t cap = b->cap ? b->cap * 2 : 16384;
+        while (cap - b->len <= (size_t)n) cap *= 2;
+        char *p = (char *)realloc(b->p, cap);
+        if (!p) {
+            b->oom = 1;
+            return;
+        }
+        b->p = p;
+        b->cap = cap;
+    }
+}
+
+/* Quoted nginx string. '$' would start a variable, so it is replaced. */
+static void out_quoted(outbuf_t *b, const char *s) {
+    char esc[2 * 128 + 1];
+    size_t o = 0;
+    for (; *s && o + 2 < sizeof(esc); s++) {
+        if (*s == '\\' || *s == '"') esc[o++] = '\\';
+        esc[o++] = *s == '$' ? '?' : *s;
+    }
+    esc[o] = '\0';
+    out_printf(b, "\"%s\"", esc);
+}
+
+static uint64_t fnv64(const void *p, size_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= b[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Whitespace or comma separated list membership */
+static int in_list(const char *list, const char *item) {
+    size_t n = strlen(item);
+    const char *p = list;
+    while (*p) {
+        p += strspn(p, " ,\t\n");
+        size_t w = strcspn(p, " ,\t\n");
+        if (w == n && !strncmp(p, item, n)) return 1;
+        p += w;
+    }
+    return 0;
+}
+
+static uint32_t pow2_at_least(uint32_t n, uint32_t min) {
+    uint32_t v = min;
+    while (v < n && v < (1u << 30)) v <<= 1;
+    return v;
+}
+
+/*
+ * Hash of the installed file: 1 if read, 0 if it does not exist, -1 on
+ * error. Files are a few hundred KiB at most, so reading them whole is fine.
+ */
+static int file_hash(const char *path, uint64_t *h, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+
+    outbuf_t b = {0};
+    char chunk[4096];
+    ssize_t r;
+    while ((r = read(fd, chunk, sizeof(chunk))) > 0) {
+        if (b.len + (size_t)r > b.cap) {
+            size_t cap = b.cap ? b.cap * 2 : 16384;
+            while (cap < b.len + (size_t)r) cap *= 2;
+            char *p = (char *)realloc(b.p, cap);
+            if (!p) break;
+            b.p = p;
+            b.cap = cap;
+        }
+        memcpy(b.p + b.len, chunk, (size_t)r);
+        b.len += (size_t)r;
+    }
+    close(fd);
+
+    int rc = r == 0 ? 1 : -1;
+    *h = fnv64(b.p, b.len);
+    *size = b.len;
+    free(b.p);
+    return rc;
+}
+
+/* Replace `path` with `b` unless the content is identical. */
+static int install(const char *path, const outbuf_t *b, int force) {
+    uint64_t old_h = 0;
+    size_t old_size = 0;
+    int have = file_hash(path, &old_h, &old_size);
+    if (have < 0) {
+        fprintf(stderr, "portal-ctxmap: cannot read %s: %s\n", path, strerror(errno));
+        return CTXMAP_ERROR;
+    }
+    if (!force && have && old_size == b->len && old_h == fnv64(b->p, b->len))
+        return CTXMAP_UNCHANGED;
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "portal-ctxmap: cannot create %s: %s\n", tmp, strerror(errno));
+        return CTXMAP_ERROR;
+    }
+
+    size_t off = 0;
+    while (off < b->len) {
+        ssize_t w = write(fd, b->p + off, b->len - off);
+        if (w <= 0) break;
+        off += (size_t)w;
+    }
+    if (close(fd) != 0 || off < b->len || rename(tmp, path) != 0) {
+        fprintf(stderr, "portal-ctxmap: cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return CTXMAP_ERROR;
+    }
+    return CTXMAP_CHANGED;
+}
+
+/* --------------------------------------------------
+ * Collection
+ * -------------------------------------------------- */
+static void on_neigh(const clientctx_neigh_row_t *row, void *arg) {
+    neigh_list_t *l = (neigh_list_t *)arg;
+    if (l->filter && !in_list(l->filter, row->ifname)) return;
+
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        clientctx_neigh_row_t *v = (clientctx_neigh_row_t *)realloc(l->v, cap * sizeof(*v));
+        if (!v) return;
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = *row;
+}
+
+static void on_sta(const clientctx_sta_row_t *row, void *arg) {
+    sta_list_t *l = (sta_list_t *)arg;
+    if (l->filter && !in_list(l->filter, row->radio)) return;
+
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        clientctx_sta_row_t *v = (clientctx_sta_row_t *)realloc(l->v, cap * sizeof(*v));
+        if (!v) return;
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = *row;
+}
+
+/* IPv4 before IPv6, then numerically */
+static int cmp_neigh(const void *a, const void *b) {
+    const clientctx_neigh_row_t *x = (const clientctx_neigh_row_t *)a;
+    const clientctx_neigh_row_t *y = (const clientctx_neigh_row_t *)b;
+    if (x->family != y->family) return x->family == AF_INET ? -1 : 1;
+    return memcmp(x->addr, y->addr, sizeof(x->addr));
+}
+
+/* Fixed-width lowercase hex, so strcmp is numeric order */
+static int cmp_sta(const void *a, const void *b) {
+    return strcmp(((const clientctx_sta_row_t *)a)->mac, ((const clientctx_sta_row_t *)b)->mac);
+}
+
+/* --------------------------------------------------
+ * Rendering
+ * -------------------------------------------------- */
+static void render_maps(outbuf_t *b, const neigh_list_t *ne, const sta_list_t *st,
+                        const char *ap_id) {
+    outbuf_t body = {0};
+
+    out_printf(&body, "map $remote_addr $portal_mac {\n    default \"\";\n");
+    for (size_t i = 0; i < ne->n; i++)
+        out_printf(&body, "    %s \"%s\";\n", ne->v[i].ip, ne->v[i].mac);
+    out_printf(&body, "}\n\n");
+
+    out_printf(&body, "map $remote_addr $portal_vlan_id {\n    default 0;\n");
+    for (size_t i = 0; i < ne->n; i++)
+        out_printf(&body, "    %s %d;\n", ne->v[i].ip, ne->v[i].vlan_id);
+    out_printf(&body, "}\n\n");
+
+    out_printf(&body, "map $portal_mac $portal_radio_id {\n    default \"\";\n");
+    for (size_t i = 0; i < st->n; i++)
+        out_printf(&body, "    %s \"%s\";\n", st->v[i].mac, st->v[i].radio);
+    out_printf(&body, "}\n\n");
+
+    /* As before: an AP without SSID reports its interface name */
+    out_printf(&body, "map $portal_mac $portal_ssid {\n    default \"\";\n");
+    for (size_t i = 0; i < st->n; i++) {
+        out_printf(&body, "    %s ", st->v[i].mac);
+        out_quoted(&body, st->v[i].ssid[0] ? st->v[i].ssid : st->v[i].radio);
+        out_printf(&body, ";\n");
+    }
+    out_printf(&body, "}\n\n");
+
+    out_printf(&body, "map \"\" $portal_ap_id {\n    default ");
+    out_quoted(&body, ap_id);
+    out_printf(&body, ";\n}\n");
+
+    if (body.oom) {
+        b->oom = 1;
+        free(body.p);
+        return;
+    }
+
+    out_printf(b, "# Auto-generated by portal-ctxmap (client_ctx_source=maps)\n"
+                  "# Client context maps (remote_addr -> MAC/SSID/radio/VLAN)\n"
+                  "# neighbours=%zu stations=%zu fnv64=%016llx\n\n",
+               ne->n, st->n, (unsigned long long)fnv64(body.p, body.len));
+    out_printf(b, "%.*s", (int)body.len, body.p);
+    free(body.p);
+}
+
+/*
+ * nginx stores a map key as { value ptr, u16 len, key } padded to a
+ * pointer; a bucket must hold the largest element plus a terminator.
+ * Sizes are computed for 64-bit pointers and rounded to powers of two
+ * so the file only changes when the client count crosses a step.
+ */
+static void render_hash(outbuf_t *b, const neigh_list_t *ne, const sta_list_t *st) {
+    size_t keys = ne->n > st->n ? ne->n : st->n;
+    size_t klen = 17;                   /* MAC */
+    for (size_t i = 0; i < ne->n; i++) {
+        size_t n = strlen(ne->v[i].ip);
+        if (n > klen) klen = n;
+    }
+
+    uint32_t elt = 8 + (uint32_t)((klen + 2 + 7) & ~(size_t)7);
+    uint32_t bucket = pow2_at_least(elt + 8, MAP_HASH_BUCKET_MIN);
+    uint32_t max = pow2_at_least((uint32_t)(keys * 2), MAP_HASH_MAX_MIN);
+
+    out_printf(b, "# Auto-generated by portal-ctxmap\n"
+                  "# Sized for portal-client-maps.conf; must sort before any file with map blocks\n\n"
+                  "map_hash_max_size %u;\n"
+                  "map_hash_bucket_size %u;\n", max, bucket);
+}
+
+/* --------------------------------------------------
+ * Main
+ * -------------------------------------------------- */
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    const char *hash_path = NULL;
+    const char *ap_id = "";
+    const char *ifs = NULL;
+    const char *radios = NULL;
+    int clients = 4096;
+    int force = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "o:s:a:i:w:n:fh")) != -1) {
+        switch (c) {
+        case 'o': out_path = optarg; break;
+        case 's': hash_path = optarg; break;
+        case 'a': ap_id = optarg; break;
+        case 'i': ifs = *optarg ? optarg : NULL; break;
+        case 'w': radios = *optarg ? optarg : NULL; break;
+        case 'n': clients = atoi(optarg); break;
+        case 'f': force = 1; break;
+        default:
+            usage(argv[0]);
+            return CTXMAP_ERROR;
+        }
+    }
+    if (!out_path || clients <= 0) {
+        usage(argv[0]);
+        return CTXMAP_ERROR;
+    }
+
+    /* One dump of neighbours, interfaces and stations */
+    signer_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.ctx_enable = 1;
+    cfg.ctx_clients = clients;
+    if (clientctx_start(&cfg) != 0) {
+        fprintf(stderr, "portal-ctxmap: netlink dump failed\n");
+        return CTXMAP_ERROR;
+    }
+
+    neigh_list_t ne = { .filter = ifs };
+    sta_list_t st = { .filter = radios };
+    clientctx_foreach_neigh(on_neigh, &ne);
+    clientctx_foreach_sta(on_sta, &st);
+    clientctx_stop();
+
+    qsort(ne.v, ne.n, sizeof(*ne.v), cmp_neigh);
+    qsort(st.v, st.n, sizeof(*st.v), cmp_sta);
+
+    outbuf_t maps = {0}, hash = {0};
+    render_maps(&maps, &ne, &st, ap_id);
+    if (hash_path)
+        render_hash(&hash, &ne, &st);
+    free(ne.v);
+    free(st.v);
+
+    int rc = CTXMAP_ERROR;
+    if (maps.oom || hash.oom) {
+        fprintf(stderr, "portal-ctxmap: out of memory\n");
+        goto out;
+    }
+
+    /* Sizing first, so nginx never sees maps larger than it allows */
+    int rc_hash = hash_path ? install(hash_path, &hash, force) : CTXMAP_UNCHANGED;
+    if (rc_hash == CTXMAP_ERROR) goto out;
+    rc = install(out_path, &maps, force);
+    if (rc == CTXMAP_UNCHANGED && rc_hash == CTXMAP_CHANGED)
+        rc = CTXMAP_CHANGED;
+
+out:
+    free(maps.p);
+    free(hash.p);
+    return rc;
+}
@@ -0,0 +1,704 @@
+/*
+ * portal-replay: drive a capture trace (capture.*) against a signer.
+ *
+ * Requests are sent open-loop at their recorded arrival times divided
+ * by the speed factor; latency is measured from the scheduled send
+ * time, so a signer that falls behind shows it as queueing delay.
+ *
+ * With -m the tool also runs a mock controller that answers each
+ * verify (single or batch) with the verdict and controller latency
+ * recorded for the same method + URI, in trace order. Point the
+ * signer under test at it (controller.addr / controller.port).
+ *
+ * The trace's own signer-side timings (accept to reply) are printed
+ * next to the replay results for comparison.
+ *
+ *   portal-replay [-t addr:port] [-s speed] [-m port] [-c conns] trace.cap
+ */
+#define _GNU_SOURCE     /* ppoll */
+
+#include "capture.h"
+#include "declog.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_REQ_MAX      4096
+#define REPLAY_RESP_MAX     512
+#define MOCK_CONNS          256
+#define MOCK_BUF            (72 * 1024)
+#define MOCK_RESP_MAX       (64 * 1024)
+
+typedef struct {
+    const char *v;
+    uint16_t    len;
+} field_t;
+
+typedef struct {
+    uint64_t t_us;
+    uint16_t status;
+    uint8_t  verdict;
+    uint8_t  source;
+    uint32_t ctrl_us;
+    uint32_t total_us;
+    field_t  f[CAPTURE_F_HOST + 1];
+} trace_req_t;
+
+static trace_req_t *g_reqs;
+static int          g_nreqs;
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* poll() with a microsecond timeout, so pacing neither spins nor rounds to ms */
+static int poll_us(struct pollfd *pfd, nfds_t n, uint64_t timeout_us) {
+    struct timespec ts = { (time_t)(timeout_us / 1000000u), (long)(timeout_us % 1000000u) * 1000 };
+    return ppoll(pfd, n, &ts, NULL);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t pct(const uint32_t *sorted, int n, double p) {
+    if (n <= 0) return 0;
+    int i = (int)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void print_pcts(const char *what, uint32_t *v, int n) {
+    qsort(v, (size_t)n, sizeof(*v), cmp_u32);
+    printf("%-10s p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f ms\n",
+           what,
+           pct(v, n, 50) / 1000.0, pct(v, n, 90) / 1000.0,
+           pct(v, n, 99) / 1000.0, pct(v, n, 99.9) / 1000.0,
+           n ? v[n - 1] / 1000.0 : 0.0);
+}
+
+/* --------------------------------------------------
+ * Trace
+ * -------------------------------------------------- */
+static int load_trace(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(capture_file_hdr_t)) {
+        close(fd);
+        return -1;
+    }
+
+    /* Kept for the whole run: fields point into it */
+    size_t size = (size_t)st.st_size;
+    char *buf = (char *)malloc(size);
+    size_t got = 0;
+    while (buf && got < size) {
+        ssize_t r = read(fd, buf + got, size - got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    close(fd);
+    if (!buf || got != size || memcmp(buf, CAPTURE_MAGIC, 8) != 0) {
+        free(buf);
+        return -1;
+    }
+
+    /* Count, then parse */
+    int cap = 0;
+    for (size_t off = sizeof(capture_file_hdr_t); off + sizeof(capture_rec_hdr_t) <= size; ) {
+        capture_rec_hdr_t h;
+        memcpy(&h, buf + off, sizeof(h));
+        if (h.len < sizeof(h) || off + h.len > size) break;
+        off += h.len;
+        cap++;
+    }
+
+    g_reqs = (trace_req_t *)calloc((size_t)(cap ? cap : 1), sizeof(*g_reqs));
+    if (!g_reqs) return -1;
+
+    size_t off = sizeof(capture_file_hdr_t);
+    for (int i = 0; i < cap; i++) {
+        capture_rec_hdr_t h;
+        memcpy(&h, buf + off, sizeof(h));
+
+        trace_req_t *r = &g_reqs[g_nreqs];
+        r->t_us = h.t_us;
+        r->status = h.status;
+        r->verdict = h.verdict;
+        r->source = h.source;
+        r->ctrl_us = h.ctrl_us;
+        r->total_us = h.total_us;
+
+        size_t p = off + sizeof(h), end = off + h.len;
+        for (int k = 0; k < h.nfields && p + 3 <= end; k++) {
+            uint8_t id = (uint8_t)buf[p];
+            uint16_t len;
+            memcpy(&len, buf + p + 1, sizeof(len));
+            if (p + 3 + len > end) break;
+            if (id >= CAPTURE_F_METHOD && id <= CAPTURE_F_HOST) {
+                r->f[id].v = buf + p + 3;
+                r->f[id].len = len;
+            }
+            p += 3 + (size_t)len;
+        }
+        off = end;
+
+        if (r->f[CAPTURE_F_METHOD].len && r->f[CAPTURE_F_URI].len)
+            g_nreqs++;
+    }
+    return 0;
+}
+
+/* --------------------------------------------------
+ * Mock controller
+ *
+ * Recorded controller answers are chained per method + URI; each
+ * lookup takes the next one in trace order and wraps at the end.
+ * URIs never seen at the controller get allow after the median
+ * recorded controller latency.
+ * -------------------------------------------------- */
+typedef struct {
+    uint64_t hash;
+    int      first;
+    int      cursor;
+} mock_key_t;
+
+typedef struct {
+    int      fd;
+    char    *buf;
+    size_t   len;
+    uint64_t due_us;            /* 0 = still reading */
+    char    *resp;
+    size_t   resp_len;
+} mock_conn_t;
+
+static mock_key_t   *g_keys;
+static uint32_t      g_kmask;
+static int          *g_next;
+static uint32_t      g_ctrl_p50;
+static _Atomic int   g_mock_run;
+static unsigned long g_mock_calls, g_mock_items, g_mock_unmatched;
+
+static uint64_t key_hash(const char *m, size_t ml, const char *u, size_t ul) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < ml; i++) { h ^= (unsigned char)m[i]; h *= 1099511628211ull; }
+    h ^= 0xff; h *= 1099511628211ull;
+    for (size_t i = 0; i < ul; i++) { h ^= (unsigned char)u[i]; h *= 1099511628211ull; }
+    return h ? h : 1;
+}
+
+static int mock_build(void) {
+    uint32_t size = 64;
+    while (size < (uint32_t)g_nreqs * 2) size <<= 1;
+    g_keys = (mock_key_t *)calloc(size, sizeof(*g_keys));
+    g_next = (int *)malloc(sizeof(int) * (size_t)(g_nreqs ? g_nreqs : 1));
+    uint32_t *lat = (uint32_t *)malloc(sizeof(uint32_t) * (size_t)(g_nreqs ? g_nreqs : 1));
+    if (!g_keys || !g_next || !lat) {
+        free(lat);
+        return -1;
+    }
+    g_kmask = size - 1;
+
+    int *last = (int *)malloc(sizeof(int) * size);
+    if (!last) {
+        free(lat);
+        return -1;
+    }
+
+    int nlat = 0;
+    for (int i = 0; i < g_nreqs; i++) {
+        const trace_req_t *r = &g_reqs[i];
+        g_next[i] = -1;
+        if (r->source != DECLOG_SRC_CONTROLLER) continue;
+        lat[nlat++] = r->ctrl_us;
+
+        uint64_t h = key_hash(r->f[CAPTURE_F_METHOD].v, r->f[CAPTURE_F_METHOD].len,
+                              r->f[CAPTURE_F_URI].v, r->f[CAPTURE_F_URI].len);
+        uint32_t b = (uint32_t)h & g_kmask;
+        while (g_keys[b].hash && g_keys[b].hash != h)
+            b = (b + 1) & g_kmask;
+        if (!g_keys[b].hash) {
+            g_keys[b].hash = h;
+            g_keys[b].first = g_keys[b].cursor = i;
+        } else {
+            g_next[last[b]] = i;
+        }
+        last[b] = i;
+    }
+    free(last);
+
+    qsort(lat, (size_t)nlat, sizeof(*lat), cmp_u32);
+    g_ctrl_p50 = pct(lat, nlat, 50);
+    free(lat);
+    return 0;
+}
+
+/* Undo controller.c json_escape() in place: \" \\ \u00XX */
+static size_t json_unescape(char *s, size_t n) {
+    size_t o = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '\\' && i + 1 < n) {
+            i++;
+            if (s[i] == 'u' && i + 4 < n) {
+                unsigned int c = 0;
+                sscanf(s + i + 1, "%4x", &c);
+                s[o++] = (char)c;
+                i += 4;
+                continue;
+            }
+        }
+        s[o++] = s[i];
+    }
+    return o;
+}
+
+/* Find "key":"value" at or after p (bounded by end); returns value length or -1. */
+static int json_str(char *p, char *end, const char *key, char **out) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":\"", key);
+    char *k = strstr(p, pat);
+    if (!k || k >= end) return -1;
+    char *v = k + strlen(pat);
+    char *q = v;
+    while (q < end && *q != '"') {
+        if (*q == '\\' && q + 1 < end) q++;
+        q++;
+    }
+    *out = v;
+    return (int)json_unescape(v, (size_t)(q - v));
+}
+
+/* Next recorded answer for method + uri: returns 1 = allow, 0 = deny. */
+static int mock_answer(const char *m, size_t ml, const char *u, size_t ul, uint32_t *delay_us) {
+    uint64_t h = key_hash(m, ml, u, ul);
+    uint32_t b = (uint32_t)h & g_kmask;
+    while (g_keys[b].hash && g_keys[b].hash != h)
+        b = (b + 1) & g_kmask;
+
+    g_mock_items++;
+    if (!g_keys[b].hash) {
+        g_mock_unmatched++;
+        *delay_us = g_ctrl_p50;
+        return 1;
+    }
+
+    const trace_req_t *r = &g_reqs[g_keys[b].cursor];
+    int nx = g_next[g_keys[b].cursor];
+    g_keys[b].cursor = nx >= 0 ? nx : g_keys[b].first;
+
+    *delay_us = r->ctrl_us;
+    return r->verdict == DECLOG_VERDICT_ALLOW;
+}
+
+/* Build the reply for one complete request; returns the delay in us. */
+static uint32_t mock_handle(mock_conn_t *c, char *body) {
+    uint32_t delay = 0;
+    char *end = c->buf + c->len;
+    g_mock_calls++;
+
+    if (!strncmp(c->buf, "GET ", 4)) {
+        c->resp_len = (size_t)snprintf(c->resp, MOCK_RESP_MAX,
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return 0;
+    }
+
+    if (!strstr(body, "\"items\"")) {
+        char *m = NULL, *u = NULL;
+        int ml = json_str(body, end, "method", &m);
+        int ul = ml >= 0 ? json_str(m + ml, end, "uri", &u) : -1;
+        int allow = 1;
+        if (ul >= 0)
+            allow = mock_answer(m, (size_t)ml, u, (size_t)ul, &delay);
+        c->resp_len = (size_t)snprintf(c->resp, MOCK_RESP_MAX,
+            allow ? "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n"
+                  : "HTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return delay;
+    }
+
+    /* Batch: the call takes as long as its slowest recorded item */
+    char out[MOCK_RESP_MAX - 256];
+    size_t off = (size_t)snprintf(out, sizeof(out), "{\"results\":[");
+    char *p = body;
+    while ((p = strstr(p, "{\"id\":")) != NULL && p < end) {
+        int id = atoi(p + 6);
+        char *m = NULL, *u = NULL;
+        int ml = json_str(p, end, "method", &m);
+        int ul = ml >= 0 ? json_str(m + ml, end, "uri", &u) : -1;
+        if (ul < 0) break;
+
+        uint32_t d = 0;
+        int allow = mock_answer(m, (size_t)ml, u, (size_t)ul, &d);
+        if (d > delay) delay = d;
+        if (off + 48 < sizeof(out))
+            off += (size_t)snprintf(out + off, sizeof(out) - off, "%s{\"id\":%d,\"status\":%d}",
+                                    off > 12 ? "," : "", id, allow ? 204 : 401);
+        p = u + ul;
+    }
+    off += (size_t)snprintf(out + off, sizeof(out) - off, "]}");
+
+    c->resp_len = (size_t)snprintf(c->resp, MOCK_RESP_MAX,
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n%s", off, out);
+    return delay;
+}
+
+static void mock_close(mock_conn_t *c) {
+    close(c->fd);
+    free(c->buf);
+    free(c->resp);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void *mock_main(void *arg) {
+    int lfd = *(int *)arg;
+    mock_conn_t conns[MOCK_CONNS];
+    struct pollfd pfd[MOCK_CONNS + 1];
+    for (int i = 0; i < MOCK_CONNS; i++) {
+        memset(&conns[i], 0, sizeof(conns[i]));
+        conns[i].fd = -1;
+    }
+
+    while (atomic_load(&g_mock_run)) {
+        uint64_t now = mono_us();
+        uint64_t timeout = 50000;
+
+        /* Answer what is due */
+        for (int i = 0; i < MOCK_CONNS; i++) {
+            mock_conn_t *c = &conns[i];
+            if (c->fd < 0 || !c->due_us) continue;
+            if (c->due_us <= now) {
+                (void)write(c->fd, c->resp, c->resp_len);
+                mock_close(c);
+            } else if (c->due_us - now < timeout) {
+                timeout = c->due_us - now;
+            }
+        }
+
+        int np = 0;
+        pfd[np].fd = lfd;
+        pfd[np++].events = POLLIN;
+        for (int i = 0; i < MOCK_CONNS; i++) {
+            pfd[np].fd = (conns[i].fd >= 0 && !conns[i].due_us) ? conns[i].fd : -1;
+            pfd[np++].events = POLLIN;
+        }
+        if (poll_us(pfd, (nfds_t)np, timeout) <= 0)
+            continue;
+
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(lfd, NULL, NULL);
+            int slot = -1;
+            for (int i = 0; fd >= 0 && i < MOCK_CONNS; i++)
+                if (conns[i].fd < 0) { slot = i; break; }
+            if (slot < 0) {
+                if (fd >= 0) close(fd);
+            } else {
+                conns[slot].fd = fd;
+                conns[slot].buf = (char *)malloc(MOCK_BUF);
+                conns[slot].resp = (char *)malloc(MOCK_RESP_MAX);
+                if (!conns[slot].buf || !conns[slot].resp)
+                    mock_close(&conns[slot]);
+            }
+        }
+
+        for (int i = 0; i < MOCK_CONNS; i++) {
+            mock_conn_t *c = &conns[i];
+            if (c->fd < 0 || c->due_us || !(pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            ssize_t r = read(c->fd, c->buf + c->len, MOCK_BUF - 1 - c->len);
+            if (r <= 0) {
+                mock_close(c);
+                continue;
+            }
+            c->len += (size_t)r;
+            c->buf[c->len] = '\0';
+
+            char *hdr_end = strstr(c->buf, "\r\n\r\n");
+            if (!hdr_end) continue;
+            const char *cl = strstr(c->buf, "Content-Length:");     /* as sent by controller.c */
+            size_t want = cl && cl < hdr_end ? (size_t)atol(cl + 15) : 0;
+            char *body = hdr_end + 4;
+            if ((size_t)(c->buf + c->len - body) < want && c->len < MOCK_BUF - 1)
+                continue;
+
+            c->due_us = mono_us() + mock_handle(c, body);
+            if (!c->due_us) c->due_us = 1;
+        }
+    }
+
+    for (int i = 0; i < MOCK_CONNS; i++)
+        if (conns[i].fd >= 0)
+            mock_close(&conns[i]);
+    return NULL;
+}
+
+static int mock_listen(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 1024) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* --------------------------------------------------
+ * Driver
+ * -------------------------------------------------- */
+typedef struct {
+    int      fd;
+    int      idx;
+    int      sending;
+    size_t   off;
+    size_t   req_len;
+    size_t   resp_len;
+    uint64_t t_sched;
+    char     req[REPLAY_REQ_MAX];
+    char     resp[REPLAY_RESP_MAX];
+} replay_conn_t;
+
+static size_t build_request(const trace_req_t *r, char *out, size_t cap) {
+    static const struct { int id; const char *name; } hdrs[] = {
+        { CAPTURE_F_METHOD, "X-Original-Method" },
+        { CAPTURE_F_URI,    "X-Original-URI" },
+        { CAPTURE_F_HOST,   "X-Original-Host" },
+        { CAPTURE_F_IP,     "X-Client-IP" },
+        { CAPTURE_F_MAC,    "X-Client-MAC" },
+        { CAPTURE_F_SSID,   "X-Client-SSID" },
+        { CAPTURE_F_RADIO,  "X-Client-Radio-ID" },
+        { CAPTURE_F_VLAN,   "X-Portal-VLAN-ID" },
+    };
+
+    size_t off = (size_t)snprintf(out, cap, "GET /__portal_auth HTTP/1.1\r\nHost: portal-signer\r\n");
+    for (size_t i = 0; i < sizeof(hdrs) / sizeof(hdrs[0]); i++) {
+        const field_t *f = &r->f[hdrs[i].id];
+        if (!f->len || off >= cap) continue;
+        off += (size_t)snprintf(out + off, cap - off, "%s: %.*s\r\n",
+                                hdrs[i].name, (int)f->len, f->v);
+    }
+    if (off < cap)
+        off += (size_t)snprintf(out + off, cap - off, "\r\n");
+    return off < cap ? off : cap - 1;
+}
+
+static int conn_start(replay_conn_t *c, const struct sockaddr_in *sa) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) return -1;
+    if (connect(c->fd, (const struct sockaddr *)sa, sizeof(*sa)) != 0 &&
+        errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    c->sending = 1;
+    c->off = 0;
+    c->resp_len = 0;
+    c->req_len = build_request(&g_reqs[c->idx], c->req, sizeof(c->req));
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: portal-replay [-t addr:port] [-s speed] [-m port] [-c conns] trace.cap\n"
+        "  -t  signer to drive (default 127.0.0.1:9000)\n"
+        "  -s  time scale: 1 = as recorded, 10, 100, ... (default 1)\n"
+        "  -m  run a mock controller on 127.0.0.1:port replaying recorded verdicts\n"
+        "  -c  concurrent connections (default 512)\n");
+}
+
+int main(int argc, char **argv) {
+    char addr[64] = "127.0.0.1";
+    int port = 9000, mock_port = 0, max_conns = 512;
+    double speed = 1.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:m:c:h")) != -1) {
+        switch (opt) {
+        case 't': {
+            char *c = strrchr(optarg, ':');
+            if (c) {
+                port = atoi(c + 1);
+                *c = '\0';
+            }
+            snprintf(addr, sizeof(addr), "%s", optarg);
+            break;
+        }
+        case 's': speed = atof(optarg); break;
+        case 'm': mock_port = atoi(optarg); break;
+        case 'c': max_conns = atoi(optarg); break;
+        default:  usage(); return 2;
+        }
+    }
+    if (optind >= argc || speed <= 0 || max_conns <= 0) {
+        usage();
+        return 2;
+    }
+
+    if (load_trace(argv[optind]) != 0) {
+        fprintf(stderr, "portal-replay: cannot read trace %s\n", argv[optind]);
+        return 1;
+    }
+    if (!g_nreqs) {
+        fprintf(stderr, "portal-replay: no requests in %s\n", argv[optind]);
+        return 1;
+    }
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        fprintf(stderr, "portal-replay: bad address %s\n", addr);
+        return 2;
+    }
+
+    pthread_t mock_thread;
+    int mock_fd = -1;
+    if (mock_port > 0) {
+        mock_fd = mock_listen(mock_port);
+        if (mock_fd < 0 || mock_build() != 0) {
+            fprintf(stderr, "portal-replay: cannot start mock controller on port %d\n", mock_port);
+            return 1;
+        }
+        atomic_store(&g_mock_run, 1);
+        pthread_create(&mock_thread, NULL, mock_main, &mock_fd);
+    }
+
+    replay_conn_t *conns = (replay_conn_t *)calloc((size_t)max_conns, sizeof(*conns));
+    struct pollfd *pfd = (struct pollfd *)calloc((size_t)max_conns, sizeof(*pfd));
+    uint32_t *lat = (uint32_t *)calloc((size_t)g_nreqs, sizeof(*lat));
+    uint32_t *rec_lat = (uint32_t *)calloc((size_t)g_nreqs, sizeof(*rec_lat));
+    if (!conns || !pfd || !lat || !rec_lat) {
+        fprintf(stderr, "portal-replay: out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < max_conns; i++)
+        conns[i].fd = -1;
+
+    printf("trace: %d requests over %.1f s, replaying at %gx against %s:%d\n",
+           g_nreqs, (g_reqs[g_nreqs - 1].t_us - g_reqs[0].t_us) / 1e6, speed, addr, port);
+
+    unsigned long by_status[6] = {0};
+    int nlat = 0, next = 0, active = 0, errors = 0, mismatched = 0;
+    uint64_t t0 = mono_us(), base = g_reqs[0].t_us;
+
+    while (next < g_nreqs || active > 0) {
+        uint64_t now = mono_us();
+
+        /* Start everything that is due and fits */
+        for (int i = 0; i < max_conns && next < g_nreqs; i++) {
+            uint64_t sched = t0 + (uint64_t)((g_reqs[next].t_us - base) / speed);
+            if (sched > now) break;
+            if (conns[i].fd >= 0) continue;
+            conns[i].idx = next;
+            conns[i].t_sched = sched;
+            next++;
+            if (conn_start(&conns[i], &sa) != 0)
+                errors++;
+            else
+                active++;
+        }
+
+        uint64_t timeout = 100000;
+        if (next < g_nreqs && active < max_conns) {
+            uint64_t sched = t0 + (uint64_t)((g_reqs[next].t_us - base) / speed);
+            now = mono_us();
+            timeout = sched > now ? sched - now : 0;
+            if (timeout > 100000) timeout = 100000;
+        }
+
+        for (int i = 0; i < max_conns; i++) {
+            pfd[i].fd = conns[i].fd;
+            pfd[i].events = conns[i].sending ? POLLOUT : POLLIN;
+            pfd[i].revents = 0;
+        }
+        if (poll_us(pfd, (nfds_t)max_conns, timeout) <= 0)
+            continue;
+
+        for (int i = 0; i < max_conns; i++) {
+            replay_conn_t *c = &conns[i];
+            if (c->fd < 0 || !pfd[i].revents) continue;
+
+            int done = 0, failed = 0;
+            if (c->sending) {
+                ssize_t w = write(c->fd, c->req + c->off, c->req_len - c->off);
+                if (w < 0 && errno != EAGAIN) failed = 1;
+                if (w > 0) c->off += (size_t)w;
+                if (c->off == c->req_len) c->sending = 0;
+            } else {
+                ssize_t r = read(c->fd, c->resp + c->resp_len, sizeof(c->resp) - 1 - c->resp_len);
+                if (r > 0) {
+                    c->resp_len += (size_t)r;
+                    c->resp[c->resp_len] = '\0';
+                    done = strstr(c->resp, "\r\n\r\n") != NULL ||
+                           c->resp_len == sizeof(c->resp) - 1;
+                } else if (r == 0 || errno != EAGAIN) {
+                    done = c->resp_len > 0;
+                    failed = !done;
+                }
+            }
+
+            if (done) {
+                int code = 0;
+                sscanf(c->resp, "HTTP/1.%*d %d", &code);
+                lat[nlat++] = (uint32_t)(mono_us() - c->t_sched);
+                by_status[code >= 100 && code < 600 ? code / 100 : 0]++;
+                if (code != g_reqs[c->idx].status) mismatched++;
+            }
+            if (done || failed) {
+                if (failed) errors++;
+                close(c->fd);
+                c->fd = -1;
+                active--;
+            }
+        }
+    }
+    double wall = (mono_us() - t0) / 1e6;
+
+    if (mock_fd >= 0) {
+        atomic_store(&g_mock_run, 0);
+        pthread_join(mock_thread, NULL);
+        close(mock_fd);
+    }
+
+    for (int i = 0; i < g_nreqs; i++)
+        rec_lat[i] = g_reqs[i].total_us;
+
+    printf("done:  %d answered, %d errors in %.2f s (%.0f req/s)\n",
+           nlat, errors, wall, wall > 0 ? nlat / wall : 0.0);
+    printf("status: 2xx %lu  4xx %lu  5xx %lu  other %lu  (%d differ from trace)\n",
+           by_status[2], by_status[4], by_status[5],
+           by_status[0] + by_status[1] + by_status[3], mismatched);
+    print_pcts("replay", lat, nlat);
+    print_pcts("recorded", rec_lat, g_nreqs);
+    if (mock_fd >= 0)
+        printf("mock:  %lu calls, %lu verdicts, %lu unmatched\n",
+               g_mock_calls, g_mock_items, g_mock_unmatched);
+
+    return errors ? 1 : 0;
+}
@@ -1,14 +1,25 @@
+#include "bypass.h"
+#include "capture.h"
+#include "clientctx.h"
 #include "config.h"
+#include "controller.h"
+#include "declog.h"
+#include "ipsetnl.h"
+#include "probe.h"
+#include "ratelimit.h"
 #include "signer.h"
+#include "uring.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>   // srand
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 /* Global runtime config */
@@ -37,6 +48,10 @@ static void reload_config(void) {
         g_cfg.controller_addr, g_cfg.controller_port,
         g_cfg.controller_path,
         g_cfg.key_file);
+
+    probe_build(&g_cfg);
+    controller_configure(&g_cfg);
+    bypass_load(&g_cfg);
 }
 
 static int create_listener(const char *addr, int port) {
@@ -63,9 +78,20 @@ static int create_listener(const char *addr, int port) {
         close(fd);
         return -4;
     }
+
+    /* Accepted sockets inherit this, bounding slow client reads */
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     return fd;
 }
 
+static void save_snapshot(void) {
+    if (!g_cfg.snapshot_enable) return;
+    if (ratelimit_snapshot_save(g_cfg.snapshot_path) != 0)
+        fprintf(stderr, "[portal-signer] snapshot: failed to write %s\n",
+                g_cfg.snapshot_path);
+}
+
 int main(int argc, char **argv) {
     (void)argc; (void)argv;
 
@@ -86,6 +112,30 @@ int main(int argc, char **argv) {
 
     reload_config();
 
+    /* Client table (buckets + verdict cache) is sized once, not reloaded */
+    if ((g_cfg.ratelimit_enable || g_cfg.probe_enable) &&
+        ratelimit_init((unsigned int)g_cfg.ratelimit_clients,
+                       g_cfg.snapshot_enable ? g_cfg.snapshot_path : NULL) != 0) {
+        fprintf(stderr, "[portal-signer] ratelimit: allocation failed, disabled\n");
+    }
+
+    /* Request buffer pool is sized once, not reloaded */
+    if (portal_signer_init(&g_cfg) != 0)
+        fprintf(stderr, "[portal-signer] mempool: allocation failed, unbounded\n");
+
+    if (declog_start(&g_cfg) != 0)
+        fprintf(stderr, "[portal-signer] declog: start failed, disabled\n");
+
+    if (capture_start(&g_cfg) != 0)
+        fprintf(stderr, "[portal-signer] capture: start failed, disabled\n");
+
+    /* Netlink subscriptions are set up once (not reloaded) */
+    if (clientctx_start(&g_cfg) != 0)
+        fprintf(stderr, "[portal-signer] clientctx: netlink setup failed, disabled\n");
+
+    if (ipsetnl_start(&g_cfg) != 0)
+        fprintf(stderr, "[portal-signer] ipset: allocation failed, disabled\n");
+
     int sfd = create_listener(g_cfg.listen_addr, g_cfg.listen_port);
     if (sfd < 0) {
         fprintf(stderr, "[portal-signer] failed to listen on %s:%d\n",
@@ -95,23 +145,86 @@ int main(int argc, char **argv) {
 
     fprintf(stderr, "[portal-signer] listening on %s:%d\n", g_cfg.listen_addr, g_cfg.listen_port);
 
+    /* I/O backend is chosen once (not reloaded) */
+    int use_uring = 0;
+    if (!strcmp(g_cfg.io_backend, "uring")) {
+        if (uring_start(&g_cfg, sfd) == 0) {
+            use_uring = 1;
+            uring_watch(clientctx_neigh_fd(), clientctx_on_neigh);
+            uring_watch(clientctx_wifi_fd(), clientctx_on_wifi);
+        } else {
+            fprintf(stderr, "[portal-signer] io: io_uring unavailable, using poll\n");
+        }
+    }
+
+    time_t next_snapshot = time(NULL) + g_cfg.snapshot_interval;
+
     while (!g_stop) {
         if (g_reload) {
             g_reload = 0;
             reload_config();
         }
 
+        if (g_cfg.snapshot_interval > 0 && time(NULL) >= next_snapshot) {
+            save_snapshot();
+            next_snapshot = time(NULL) + g_cfg.snapshot_interval;
+        }
+
+        /* Listener + netlink event sockets; 1s tick for housekeeping.
+         * Queued ipset changes are written once no request is waiting,
+         * so a burst of grants leaves as one batch. */
+        struct pollfd pfd[3] = {
+            { .fd = sfd,                  .events = POLLIN },
+            { .fd = clientctx_neigh_fd(), .events = POLLIN },
+            { .fd = clientctx_wifi_fd(),  .events = POLLIN },
+        };
+        int timeout = ipsetnl_pending() ? 0 : 1000;
+        int batch_ms = portal_signer_batch_timeout();
+        if (batch_ms >= 0 && batch_ms < timeout)
+            timeout = batch_ms;
+
+        /* uring handles requests and netlink events inside the wait */
+        int ready = use_uring ? uring_wait(&g_cfg, timeout) : poll(pfd, 3, timeout);
+        if (ready == 0)
+            (void)ipsetnl_flush();
+        portal_signer_batch_flush(&g_cfg, 0);
+        ipsetnl_tick();
+        controller_tick(&g_cfg);
+        capture_tick();
+        bypass_tick(&g_cfg);
+        if (use_uring || ready <= 0)
+            continue;
+
+        if (pfd[1].revents & POLLIN)
+            clientctx_on_neigh();
+        if (pfd[2].revents & POLLIN)
+            clientctx_on_wifi();
+        if (!(pfd[0].revents & POLLIN))
+            continue;
+
         int cfd = accept(sfd, NULL, NULL);
         if (cfd < 0) {
-            if (errno == EINTR) continue;
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
             perror("accept");
             break;
         }
 
-        portal_signer_handle_client(cfd, &g_cfg);
-        close(cfd);
+        if (!portal_signer_handle_client(cfd, &g_cfg))
+            close(cfd);
     }
 
+    portal_signer_batch_flush(&g_cfg, 1);
+    if (use_uring)
+        uring_stop();
+    capture_stop();
     close(sfd);
+    save_snapshot();
+    (void)ipsetnl_flush();
+    ipsetnl_stop();
+    clientctx_stop();
+    declog_stop();
+    bypass_stop();
+    ratelimit_shutdown();
+    portal_signer_shutdown();
     return 0;
 }
@@ -0,0 +1,108 @@
+#include "probe.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROBE_PATH_MAX   128
+#define PROBE_SLOTS_MAX  256        /* power of two */
+#define PROBE_SEED_TRIES 100000
+
+typedef struct {
+    uint32_t seed;
+    uint32_t mask;                  /* slots - 1, 0 = empty table */
+    int8_t   slot[PROBE_SLOTS_MAX]; /* slot -> key index, -1 = empty */
+    char     key[PROBE_MAX_URIS][PROBE_PATH_MAX];
+} probe_table_t;
+
+static probe_table_t g_probe;
+
+static uint32_t probe_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    /* final avalanche so the low bits depend on the whole key */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+/* Try to place every key in its own slot with the given seed. */
+static int try_seed(char keys[][PROBE_PATH_MAX], int n, uint32_t mask, uint32_t seed) {
+    uint8_t used[PROBE_SLOTS_MAX];
+    memset(used, 0, mask + 1);
+
+    for (int i = 0; i < n; i++) {
+        uint32_t s = probe_hash(keys[i], strlen(keys[i]), seed) & mask;
+        if (used[s]) return -1;
+        used[s] = 1;
+    }
+    return 0;
+}
+
+int probe_build(const signer_config_t *cfg) {
+    char keys[PROBE_MAX_URIS][PROBE_PATH_MAX];
+    int n = 0;
+
+    memset(&g_probe, 0, sizeof(g_probe));
+    if (!cfg->probe_enable)
+        return 0;
+
+    /* Split "a,b c" on commas / whitespace, dropping duplicates */
+    char list[sizeof(cfg->probe_uris)];
+    snprintf(list, sizeof(list), "%s", cfg->probe_uris);
+
+    for (char *tok = strtok(list, ", \t"); tok && n < PROBE_MAX_URIS;
+         tok = strtok(NULL, ", \t")) {
+        if (tok[0] != '/' || strlen(tok) >= PROBE_PATH_MAX)
+            continue;
+        int dup = 0;
+        for (int i = 0; i < n; i++)
+            if (!strcmp(keys[i], tok)) dup = 1;
+        if (!dup)
+            snprintf(keys[n++], PROBE_PATH_MAX, "%s", tok);
+    }
+    if (n == 0)
+        return 0;
+
+    /* Start at 2x load and grow until a collision-free seed is found */
+    for (uint32_t slots = 2; slots <= PROBE_SLOTS_MAX; slots <<= 1) {
+        if (slots < (uint32_t)n * 2)
+            continue;
+        for (uint32_t seed = 1; seed <= PROBE_SEED_TRIES; seed++) {
+            if (try_seed(keys, n, slots - 1, seed) != 0)
+                continue;
+
+            g_probe.seed = seed;
+            g_probe.mask = slots - 1;
+            memset(g_probe.slot, -1, sizeof(g_probe.slot));
+            memcpy(g_probe.key, keys, sizeof(keys));
+            for (int i = 0; i < n; i++) {
+                uint32_t s = probe_hash(keys[i], strlen(keys[i]), seed) & g_probe.mask;
+                g_probe.slot[s] = (int8_t)i;
+            }
+            fprintf(stderr, "[portal-signer] probe: %d paths, %u slots, seed=%u\n",
+                    n, slots, seed);
+            return n;
+        }
+    }
+
+    fprintf(stderr, "[portal-signer] probe: no perfect hash found, fast path disabled\n");
+    return 0;
+}
+
+int probe_match(const char *uri) {
+    if (!g_probe.mask || !uri) return 0;
+
+    size_t len = strcspn(uri, "?");
+    if (len == 0 || len >= PROBE_PATH_MAX) return 0;
+
+    int idx = g_probe.slot[probe_hash(uri, len, g_probe.seed) & g_probe.mask];
+    if (idx < 0) return 0;
+
+    const char *key = g_probe.key[idx];
+    return strncmp(key, uri, len) == 0 && key[len] == '\0';
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "config.h"
+
+/*
+ * OS connectivity probe recognition (/generate_204, /hotspot-detect.html, ...).
+ *
+ * The configured probe paths (probe.uris) are compiled into a perfect hash
+ * table on every config load: a single seed is searched so that every path
+ * lands in its own slot, making a lookup one hash plus one strcmp.
+ *
+ * Recognised probes skip v1 signing and are answered from the local
+ * verdict cache when the client is known to be allowed; anything else
+ * falls back to the normal controller path.
+ */
+
+#define PROBE_MAX_URIS 32
+
+/* (Re)build the table from cfg->probe_uris. Returns number of paths loaded. */
+int probe_build(const signer_config_t *cfg);
+
+/* 1 if the path part of `uri` (query ignored) is a configured probe. */
+int probe_match(const char *uri);
@@ -0,0 +1,423 @@
+#include "ratelimit.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RL_WAYS        8
+#define RL_MILLI       1000u
+
+#define RL_SNAP_MAGIC   "PSIGSNP"
+#define RL_SNAP_VERSION 1
+
+typedef struct {
+    uint64_t fp;            /* key fingerprint, 0 = empty slot */
+    uint32_t last_ms;       /* last refill, monotonic ms (wraps, diff is unsigned) */
+    uint32_t tokens;        /* milli-tokens */
+    uint32_t verdict_exp;   /* monotonic seconds, 0 = no verdict */
+    uint8_t  ref;           /* CLOCK reference bit */
+    uint8_t  verdict;       /* rl_verdict_t */
+    uint8_t  pad[2];
+} rl_entry_t;
+
+/*
+ * Snapshot file layout (all host byte order):
+ *
+ *   rl_snap_hdr_t
+ *   uint32_t set_crc[sets]     CRC-32 of each set's RL_WAYS entries
+ *   uint8_t  hands[sets]
+ *   (pad to 8)
+ *   rl_entry_t slots[sets * RL_WAYS]
+ *
+ * On warm start the file is mmap()ed MAP_PRIVATE and used in place as
+ * the table, so startup cost does not depend on its size. Each set's
+ * CRC is checked the first time the set is touched; a bad set is simply
+ * cleared. Expired verdicts are already ignored on read.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t sets;
+    uint32_t ways;
+    uint32_t entry_size;
+    char     boot_id[40];       /* monotonic timestamps are per boot */
+    uint64_t saved_at;          /* unix seconds, informational */
+    uint32_t hdr_crc;           /* CRC-32 of this header with hdr_crc = 0 */
+    uint32_t pad;
+} rl_snap_hdr_t;
+
+static rl_entry_t *g_slots;
+static uint8_t    *g_hands;     /* one CLOCK hand per set */
+static uint32_t    g_set_mask;
+
+/* Warm start state: mapping backing g_slots / g_hands, and sets not yet
+ * checked against their snapshot CRC (NULL = everything trusted). */
+static void       *g_map;
+static size_t      g_map_len;
+static const uint32_t *g_set_crc;
+static uint8_t    *g_unchecked;
+
+static uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/* FNV-1a over the (case-folded) key; never returns 0. */
+static uint64_t key_hash(const char *key) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= (uint64_t)tolower(*p);
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+static uint32_t crc32_buf(uint32_t crc, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *)buf;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+static uint32_t sets_for(unsigned int max_clients) {
+    /* Round the set count up to a power of two */
+    uint32_t sets = 1;
+    while ((uint64_t)sets * RL_WAYS < max_clients && sets < (1u << 24))
+        sets <<= 1;
+    return sets;
+}
+
+static size_t snap_slots_off(uint32_t sets) {
+    size_t off = sizeof(rl_snap_hdr_t) + (size_t)sets * (sizeof(uint32_t) + 1);
+    return (off + 7) & ~(size_t)7;
+}
+
+static void read_boot_id(char out[40]) {
+    memset(out, 0, 40);
+    FILE *f = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (!f) return;
+    if (fgets(out, 40, f))
+        out[strcspn(out, "\n")] = '\0';
+    fclose(f);
+}
+
+static void snap_hdr_fill(rl_snap_hdr_t *h, uint32_t sets) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, RL_SNAP_MAGIC, sizeof(RL_SNAP_MAGIC));
+    h->version = RL_SNAP_VERSION;
+    h->sets = sets;
+    h->ways = RL_WAYS;
+    h->entry_size = sizeof(rl_entry_t);
+    read_boot_id(h->boot_id);
+}
+
+/* Map a snapshot written by this boot with the same geometry. */
+static int snapshot_map(const char *path, uint32_t sets) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    size_t want = snap_slots_off(sets) + (size_t)sets * RL_WAYS * sizeof(rl_entry_t);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != want) {
+        close(fd);
+        return -2;
+    }
+
+    void *m = mmap(NULL, want, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -3;
+
+    rl_snap_hdr_t hdr, expect;
+    memcpy(&hdr, m, sizeof(hdr));
+    uint32_t crc = hdr.hdr_crc;
+    hdr.hdr_crc = 0;
+    snap_hdr_fill(&expect, sets);
+
+    if (crc32_buf(0, &hdr, sizeof(hdr)) != crc ||
+        memcmp(hdr.magic, expect.magic, sizeof(hdr.magic)) != 0 ||
+        hdr.version != expect.version ||
+        hdr.sets != sets || hdr.ways != RL_WAYS ||
+        hdr.entry_size != sizeof(rl_entry_t) ||
+        memcmp(hdr.boot_id, expect.boot_id, sizeof(hdr.boot_id)) != 0) {
+        munmap(m, want);
+        return -4;
+    }
+
+    g_map = m;
+    g_map_len = want;
+    g_set_crc = (const uint32_t *)((char *)m + sizeof(rl_snap_hdr_t));
+    g_hands = (uint8_t *)((char *)m + sizeof(rl_snap_hdr_t) + (size_t)sets * sizeof(uint32_t));
+    g_slots = (rl_entry_t *)((char *)m + snap_slots_off(sets));
+    return 0;
+}
+
+int ratelimit_init(unsigned int max_clients, const char *snapshot_path) {
+    ratelimit_shutdown();
+
+    uint32_t sets = sets_for(max_clients);
+    g_set_mask = sets - 1;
+
+    if (snapshot_path && *snapshot_path && snapshot_map(snapshot_path, sets) == 0) {
+        g_unchecked = (uint8_t *)malloc(sets);
+        if (!g_unchecked) {
+            ratelimit_shutdown();
+            return -1;
+        }
+        memset(g_unchecked, 1, sets);
+        fprintf(stderr, "[portal-signer] ratelimit: warm start from %s (%u slots)\n",
+                snapshot_path, sets * RL_WAYS);
+        return 0;
+    }
+
+    g_slots = (rl_entry_t *)calloc((size_t)sets * RL_WAYS, sizeof(rl_entry_t));
+    g_hands = (uint8_t *)calloc(sets, 1);
+    if (!g_slots || !g_hands) {
+        ratelimit_shutdown();
+        return -1;
+    }
+
+    fprintf(stderr, "[portal-signer] ratelimit: %u slots (%zu bytes)\n",
+            sets * RL_WAYS,
+            (size_t)sets * (RL_WAYS * sizeof(rl_entry_t) + 1));
+    return 0;
+}
+
+void ratelimit_shutdown(void) {
+    if (g_map) {
+        munmap(g_map, g_map_len);
+    } else {
+        free(g_slots);
+        free(g_hands);
+    }
+    free(g_unchecked);
+    g_map = NULL;
+    g_map_len = 0;
+    g_set_crc = NULL;
+    g_unchecked = NULL;
+    g_slots = NULL;
+    g_hands = NULL;
+    g_set_mask = 0;
+}
+
+/* Entries of `set`, validating it against the snapshot on first touch. */
+static rl_entry_t *set_ways(uint32_t set) {
+    rl_entry_t *ways = &g_slots[(size_t)set * RL_WAYS];
+
+    if (g_unchecked && g_unchecked[set]) {
+        g_unchecked[set] = 0;
+        if (crc32_buf(0, ways, RL_WAYS * sizeof(rl_entry_t)) != g_set_crc[set]) {
+            memset(ways, 0, RL_WAYS * sizeof(rl_entry_t));
+            g_hands[set] = 0;
+        }
+        /* hands are not covered by the set CRC */
+        if (g_hands[set] >= RL_WAYS)
+            g_hands[set] = 0;
+    }
+    return ways;
+}
+
+int ratelimit_snapshot_save(const char *path) {
+    if (!g_slots || !path || !*path) return -1;
+
+    uint32_t sets = g_set_mask + 1;
+    size_t slots_off = snap_slots_off(sets);
+    size_t hdr_len = slots_off;
+
+    /* Header + per-set CRCs + hands + padding, then the slots verbatim */
+    uint8_t *head = (uint8_t *)calloc(1, hdr_len);
+    if (!head) return -2;
+
+    rl_snap_hdr_t *hdr = (rl_snap_hdr_t *)head;
+    snap_hdr_fill(hdr, sets);
+    hdr->saved_at = (uint64_t)time(NULL);
+    hdr->hdr_crc = crc32_buf(0, hdr, sizeof(*hdr));
+
+    uint32_t *crc = (uint32_t *)(head + sizeof(rl_snap_hdr_t));
+    uint8_t *hands = head + sizeof(rl_snap_hdr_t) + (size_t)sets * sizeof(uint32_t);
+    for (uint32_t i = 0; i < sets; i++) {
+        crc[i] = crc32_buf(0, set_ways(i), RL_WAYS * sizeof(rl_entry_t));
+        hands[i] = g_hands[i];
+    }
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+
+    int rc = -3;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        size_t slots_len = (size_t)sets * RL_WAYS * sizeof(rl_entry_t);
+        if (write(fd, head, hdr_len) == (ssize_t)hdr_len &&
+            write(fd, g_slots, slots_len) == (ssize_t)slots_len)
+            rc = 0;
+        close(fd);
+        if (rc == 0 && rename(tmp, path) != 0)
+            rc = -4;
+        if (rc != 0)
+            unlink(tmp);
+    }
+
+    free(head);
+    return rc;
+}
+
+int ratelimit_client_key(const portal_client_t *cli, char *out, size_t out_sz) {
+    if (!cli || !out || out_sz == 0) return -1;
+
+    if (cli->mac[0]) {
+        snprintf(out, out_sz, "mac:%s", cli->mac);
+        return 0;
+    }
+    if (cli->ip[0]) {
+        snprintf(out, out_sz, "ip:%s", cli->ip);
+        return 0;
+    }
+    out[0] = '\0';
+    return -1;
+}
+
+void ratelimit_resolve(const signer_config_t *cfg, const portal_client_t *cli,
+                       int *rate, int *burst) {
+    *rate = cfg->ratelimit_rate;
+    *burst = cfg->ratelimit_burst;
+
+    const signer_rl_rule_t *vlan_rule = NULL;
+
+    for (int i = 0; i < cfg->ratelimit_nrules; i++) {
+        const signer_rl_rule_t *r = &cfg->ratelimit_rules[i];
+
+        if (r->ssid[0]) {
+            if (cli->ssid[0] && strcmp(r->ssid, cli->ssid) == 0) {
+                *rate = r->rate;
+                *burst = r->burst;
+                return;
+            }
+        } else if (!vlan_rule && cli->vlan_id > 0 && r->vlan_id == cli->vlan_id) {
+            vlan_rule = r;
+        }
+    }
+
+    if (vlan_rule) {
+        *rate = vlan_rule->rate;
+        *burst = vlan_rule->burst;
+    }
+}
+
+/* Find the slot for `key` without inserting; NULL if absent. */
+static rl_entry_t *lookup(const char *key) {
+    uint64_t fp = key_hash(key);
+    uint32_t set = (uint32_t)(fp ^ (fp >> 32)) & g_set_mask;
+    rl_entry_t *ways = set_ways(set);
+
+    for (int i = 0; i < RL_WAYS; i++) {
+        if (ways[i].fp == fp) {
+            ways[i].ref = 1;
+            return &ways[i];
+        }
+    }
+    return NULL;
+}
+
+/* Find the slot for `key`, inserting (and evicting via CLOCK) if absent. */
+static rl_entry_t *lookup_or_insert(const char *key, int *inserted) {
+    uint64_t fp = key_hash(key);
+    uint32_t set = (uint32_t)(fp ^ (fp >> 32)) & g_set_mask;
+    rl_entry_t *ways = set_ways(set);
+
+    *inserted = 0;
+
+    rl_entry_t *empty = NULL;
+    for (int i = 0; i < RL_WAYS; i++) {
+        if (ways[i].fp == fp) {
+            ways[i].ref = 1;
+            return &ways[i];
+        }
+        if (!empty && ways[i].fp == 0)
+            empty = &ways[i];
+    }
+
+    rl_entry_t *victim = empty;
+    if (!victim) {
+        uint8_t hand = g_hands[set];
+        while (ways[hand].ref) {
+            ways[hand].ref = 0;
+            hand = (uint8_t)((hand + 1) % RL_WAYS);
+        }
+        victim = &ways[hand];
+        g_hands[set] = (uint8_t)((hand + 1) % RL_WAYS);
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->fp = fp;
+    victim->ref = 1;
+    *inserted = 1;
+    return victim;
+}
+
+int ratelimit_take(const char *key, int rate, int burst, rl_verdict_t *cached) {
+    if (cached) *cached = RL_VERDICT_NONE;
+
+    /* Disabled, no key, or unlimited rule */
+    if (!g_slots || !key || !*key || rate <= 0) return 1;
+    if (burst <= 0) burst = rate;
+
+    uint64_t now = mono_ms();
+    uint32_t now_ms = (uint32_t)now;
+    uint32_t cap = (uint32_t)burst * RL_MILLI;
+
+    int inserted = 0;
+    rl_entry_t *e = lookup_or_insert(key, &inserted);
+
+    if (inserted) {
+        e->tokens = cap;
+    } else {
+        /* Lazy refill: rate tokens/s == rate milli-tokens/ms */
+        uint64_t add = (uint64_t)(uint32_t)(now_ms - e->last_ms) * (uint64_t)rate;
+        uint64_t t = (uint64_t)e->tokens + add;
+        e->tokens = t > cap ? cap : (uint32_t)t;
+    }
+    e->last_ms = now_ms;
+
+    if (e->tokens >= RL_MILLI) {
+        e->tokens -= RL_MILLI;
+        return 1;
+    }
+
+    if (cached && e->verdict_exp && (uint32_t)(now / 1000u) < e->verdict_exp)
+        *cached = (rl_verdict_t)e->verdict;
+    return 0;
+}
+
+rl_verdict_t ratelimit_get_verdict(const char *key) {
+    if (!g_slots || !key || !*key) return RL_VERDICT_NONE;
+
+    rl_entry_t *e = lookup(key);
+    if (!e || !e->verdict_exp || (uint32_t)(mono_ms() / 1000u) >= e->verdict_exp)
+        return RL_VERDICT_NONE;
+    return (rl_verdict_t)e->verdict;
+}
+
+void ratelimit_set_verdict(const char *key, rl_verdict_t v, unsigned int ttl_sec) {
+    if (!g_slots || !key || !*key) return;
+
+    int inserted = 0;
+    rl_entry_t *e = lookup_or_insert(key, &inserted);
+    if (inserted) {
+        /* Normally take() ran first; start empty and refill from now */
+        e->tokens = 0;
+        e->last_ms = (uint32_t)mono_ms();
+    }
+
+    e->verdict = (uint8_t)v;
+    e->verdict_exp = ttl_sec ? (uint32_t)(mono_ms() / 1000u) + ttl_sec : 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "signer.h"
+
+/*
+ * Per-client token buckets for the auth_request verify path.
+ *
+ * Clients are keyed by X-Client-MAC (falling back to X-Client-IP) and
+ * stored in a fixed-size, 8-way set-associative table allocated once at
+ * startup. Buckets are refilled lazily on access (no timers) and a full
+ * set evicts with a per-set CLOCK hand, so memory use never grows with
+ * the number of clients seen: ~24 bytes per slot, 16384 slots ≈ 384 KiB.
+ *
+ * Each slot also remembers the client's last controller verdict, which
+ * is what an over-limit request (or a recognised OS probe, see probe.h)
+ * is answered with locally. The table can be snapshotted to a file and
+ * mapped back on restart so a respawned signer keeps what it learned.
+ *
+ * Not thread-safe: called from the single accept loop only.
+ */
+
+typedef enum {
+    RL_VERDICT_NONE = 0,
+    RL_VERDICT_ALLOW,
+    RL_VERDICT_DENY,
+} rl_verdict_t;
+
+/*
+ * Allocate the table for at least max_clients entries. If snapshot_path
+ * names a valid snapshot from this boot with the same geometry, it is
+ * mapped in place instead (warm restart). Returns 0 on success.
+ */
+int  ratelimit_init(unsigned int max_clients, const char *snapshot_path);
+void ratelimit_shutdown(void);
+
+/* Write the table to `path` atomically (tmp + rename). Returns 0 on success. */
+int  ratelimit_snapshot_save(const char *path);
+
+/* Build the bucket key for a client (MAC preferred, IP fallback).
+ * Returns 0 if a key is available, -1 otherwise. */
+int  ratelimit_client_key(const portal_client_t *cli, char *out, size_t out_sz);
+
+/* Resolve rate/burst for a client: SSID rule, then VLAN rule, then default. */
+void ratelimit_resolve(const signer_config_t *cfg, const portal_client_t *cli,
+                       int *rate, int *burst);
+
+/*
+ * Take one token for `key`.
+ *
+ * Returns 1 if the request may proceed, 0 if the client is over its limit.
+ * When over limit, *cached receives the last unexpired verdict
+ * (RL_VERDICT_NONE if there is none).
+ */
+int  ratelimit_take(const char *key, int rate, int burst, rl_verdict_t *cached);
+
+/* Last unexpired verdict for `key` without touching its bucket. */
+rl_verdict_t ratelimit_get_verdict(const char *key);
+
+/* Remember the controller verdict for `key` for ttl_sec seconds. */
+void ratelimit_set_verdict(const char *key, rl_verdict_t v, unsigned int ttl_sec);
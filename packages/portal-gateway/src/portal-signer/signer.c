@@ -1,29 +1,102 @@
 #include "signer.h"
+#include "bypass.h"
+#include "capture.h"
+#include "clientctx.h"
+#include "controller.h"
 #include "crypto_hmac.h"
+#include "declog.h"
+#include "ipsetnl.h"
+#include "mempool.h"
+#include "probe.h"
+#include "ratelimit.h"
 
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
 #define MAX_LINE 1024
 #define MAX_BODY (64 * 1024)
+#define SIGN_STREAM_BUF (16 * 1024)
+#define SIGNER_IN_BUF   4096
 
-static ssize_t read_line(int fd, char *buf, size_t cap) {
+/* handle_request(): connection handed to a /sign/raw worker (not parked, not to be closed) */
+#define REQ_DETACHED    2
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/*
+ * Buffered request input. `buf` may already hold the first bytes (the
+ * io_uring backend receives them); more are read from `fd` as needed.
+ * One request per connection, so reading past it is harmless.
+ * With `deadline_us` set, a read that would wait past it fails with
+ * ETIMEDOUT instead of blocking for the socket's receive timeout.
+ */
+typedef struct {
+    int      fd;
+    char    *buf;
+    size_t   cap;
+    size_t   len;
+    size_t   off;
+    uint64_t deadline_us;
+} conn_in_t;
+
+static int in_fill(conn_in_t *in) {
+    for (;;) {
+        if (in->deadline_us) {
+            uint64_t now = mono_us();
+            struct pollfd pfd = { in->fd, POLLIN, 0 };
+            int ms = now < in->deadline_us ? (int)((in->deadline_us - now + 999) / 1000) : 0;
+            int pr = poll(&pfd, 1, ms);
+            if (pr < 0 && errno == EINTR) continue;
+            if (pr == 0) errno = ETIMEDOUT;
+            if (pr <= 0) return -1;
+        }
+        ssize_t r = read(in->fd, in->buf, in->cap);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return (int)r;
+        in->len = (size_t)r;
+        in->off = 0;
+        return 1;
+    }
+}
+
+/* Up to `cap` bytes; 0 at EOF, -1 on error */
+static ssize_t in_read(conn_in_t *in, void *dst, size_t cap) {
+    if (in->off == in->len) {
+        int r = in_fill(in);
+        if (r <= 0) return r;
+    }
+    size_t n = in->len - in->off;
+    if (n > cap) n = cap;
+    memcpy(dst, in->buf + in->off, n);
+    in->off += n;
+    return (ssize_t)n;
+}
+
+static ssize_t read_line(conn_in_t *in, char *buf, size_t cap) {
     size_t n = 0;
     while (n + 1 < cap) {
-        char c;
-        ssize_t r = read(fd, &c, 1);
-        if (r == 0) break;
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            return -1;
+        if (in->off == in->len) {
+            int r = in_fill(in);
+            if (r == 0) break;
+            if (r < 0) return -1;
         }
+        char c = in->buf[in->off++];
         buf[n++] = c;
         if (c == '\n') break;
     }
@@ -39,14 +112,69 @@ static void rstrip_crlf(char *s) {
     }
 }
 
-static void http_reply(int fd, int code, const char *msg) {
-    char buf[256];
+/* --------------------------------------------------
+ * Reply transport (io.backend)
+ * -------------------------------------------------- */
+static void io_send_writev(int fd, const struct iovec *iov, int iovcnt) {
+    (void)writev(fd, iov, iovcnt);
+}
+
+static void io_close_sync(int fd) {
+    close(fd);
+}
+
+static const portal_signer_io_t g_io_sync = { io_send_writev, io_close_sync };
+/* Per thread: /sign/raw workers always reply with writev() / close() */
+static __thread const portal_signer_io_t *g_io = &g_io_sync;
+
+void portal_signer_set_io(const portal_signer_io_t *io) {
+    g_io = io ? io : &g_io_sync;
+}
+
+void portal_signer_close(int fd) {
+    g_io->close(fd);
+}
+
+static void conn_send(int fd, const void *buf, size_t len) {
+    struct iovec iov = { (void *)buf, len };
+    g_io->send(fd, &iov, 1);
+}
+
+/* Empty-body reply; `extra` is zero or more complete "Name: value\r\n" lines. */
+static void http_reply_hdrs(int fd, int code, const char *msg, const char *extra) {
+    char buf[768];
     int n = snprintf(buf, sizeof(buf),
         "HTTP/1.1 %d %s\r\n"
+        "%s"
         "Content-Length: 0\r\n"
         "\r\n",
-        code, msg ? msg : "");
-    (void)write(fd, buf, (size_t)n);
+        code, msg ? msg : "", extra ? extra : "");
+    if (n < 0) return;
+    if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    conn_send(fd, buf, (size_t)n);
+}
+
+static void http_reply(int fd, int code, const char *msg) {
+    http_reply_hdrs(fd, code, msg, NULL);
+}
+
+/* Client context response headers for nginx auth_request_set */
+static void format_ctx_headers(const portal_client_t *cli, char *out, size_t cap) {
+    size_t off = 0;
+    out[0] = '\0';
+
+#define CTX_HDR(cond, fmt, val) \
+    if ((cond) && off < cap) { \
+        int w = snprintf(out + off, cap - off, fmt "\r\n", val); \
+        if (w > 0) off += (size_t)w; \
+    }
+
+    CTX_HDR(cli->mac[0],     "X-Client-MAC: %s",      cli->mac);
+    CTX_HDR(cli->ssid[0],    "X-Client-SSID: %s",     cli->ssid);
+    CTX_HDR(cli->radio[0],   "X-Client-Radio-ID: %s", cli->radio);
+    CTX_HDR(cli->vlan_id > 0, "X-Portal-VLAN-ID: %d",  cli->vlan_id);
+
+#undef CTX_HDR
 }
 
 static void http_reply_json(int fd, int code, const char *json) {
@@ -59,8 +187,27 @@ static void http_reply_json(int fd, int code, const char *json) {
         "Content-Length: %d\r\n"
         "\r\n",
         code, body_len);
-    (void)write(fd, hdr, (size_t)n);
-    (void)write(fd, json, (size_t)body_len);
+    struct iovec iov[2] = {
+        { hdr, (size_t)n },
+        { (void *)json, (size_t)body_len },
+    };
+    g_io->send(fd, iov, 2);
+}
+
+/* Returns the value of `line` if it is header `name` ("Name:"), else NULL. */
+static const char *header_value(const char *line, const char *name) {
+    size_t n = strlen(name);
+    if (strncasecmp(line, name, n) != 0) return NULL;
+    const char *v = line + n;
+    while (*v == ' ' || *v == '\t') v++;
+    return v;
+}
+
+/* Copy a header value into a fixed field, cut to fit (like snprintf) */
+static void header_copy(char *dst, size_t cap, const char *v) {
+    size_t n = strnlen(v, cap - 1);
+    memcpy(dst, v, n);
+    dst[n] = '\0';
 }
 
 static int parse_request_line(const char *line, char method[16], char path[512]) {
@@ -147,109 +294,37 @@ static void split_uri(const char *uri, char *out_path, size_t out_path_sz, char
     snprintf(out_query, out_query_sz, "%s", q + 1);
 }
 
-/* Very small controller verify call:
- * POST cfg->controller_path to cfg->controller_addr:cfg->controller_port
- * with JSON body containing original request + security fields.
- *
- * Controller returns 2xx/204 for allow; otherwise deny.
- */
-static int controller_verify(
-    const signer_config_t *cfg,
-    const char *orig_method,
-    const char *orig_uri,
-    const portal_sig_t *sig
-) {
-    if (!cfg ||
-        cfg->controller_addr[0] == '\0' ||
-        cfg->controller_path[0] == '\0') {
-        return -1;
-    }
-
-    char body[1024];
-    int blen = snprintf(body, sizeof(body),
+/* Request described by the X-Sign-* headers of POST /sign/raw */
+typedef struct {
+    char method[16];
+    char path[512];
+    char query[512];
+} sign_target_t;
+
+static void reply_sig_json(int cfd, const portal_sig_t *sig) {
+    char resp[512];
+    snprintf(resp, sizeof(resp),
         "{"
-          "\"method\":\"%s\","
-          "\"uri\":\"%s\","
-          "\"security\":{"
-            "\"kid\":\"%s\","
-            "\"timestamp\":\"%s\","
-            "\"nonce\":\"%s\","
-            "\"signature\":\"%s\""
-          "}"
+          "\"kid\":\"%s\","
+          "\"timestamp\":\"%s\","
+          "\"nonce\":\"%s\","
+          "\"signature\":\"%s\""
         "}",
-        orig_method ? orig_method : "",
-        orig_uri ? orig_uri : "",
         "v1",
         sig->timestamp,
         sig->nonce,
         sig->signature
     );
-    if (blen <= 0 || blen >= (int)sizeof(body)) return -2;
-
-    int s = socket(AF_INET, SOCK_STREAM, 0);
-    if (s < 0) return -3;
-
-    struct sockaddr_in sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(cfg->controller_port);
-    if (inet_pton(AF_INET, cfg->controller_addr, &sa.sin_addr) != 1) {
-        close(s);
-        return -4;
-    }
-
-    if (connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
-        close(s);
-        return -5;
-    }
-
-    char req[2048];
-    int rlen = snprintf(req, sizeof(req),
-        "POST %s HTTP/1.1\r\n"
-        "Host: %s:%d\r\n"
-        "Content-Type: application/json\r\n"
-        "Content-Length: %d\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "%s",
-        cfg->controller_path,
-        cfg->controller_addr,
-        cfg->controller_port,
-        blen,
-        body
-    );
-    if (rlen <= 0 || rlen >= (int)sizeof(req)) {
-        close(s);
-        return -6;
-    }
 
-    if (write(s, req, (size_t)rlen) != rlen) {
-        close(s);
-        return -7;
-    }
-
-    /* Read status line */
-    char line[MAX_LINE];
-    ssize_t n = read_line(s, line, sizeof(line));
-    close(s);
-    if (n <= 0) return -8;
-
-    /* HTTP/1.1 204 No Content */
-    int code = 0;
-    if (sscanf(line, "HTTP/%*s %d", &code) != 1) return -9;
-
-    if (code >= 200 && code < 300) return 0;
-    return -10;
+    http_reply_json(cfd, 200, resp);
 }
 
-static void handle_sign_endpoint(int cfd, const signer_config_t *cfg, const char *req_body, size_t req_body_len) {
-    (void)req_body_len;
+static void handle_sign_endpoint(int cfd, const signer_config_t *cfg, char *req_body, size_t req_body_len) {
 
     /* Parse JSON input */
     char method[16] = {0};
     char path[512] = {0};
     char raw_query[512] = {0};
-    char body_str[MAX_BODY] = {0};
 
     if (json_get_string(req_body, "method", method, sizeof(method)) != 0 ||
         json_get_string(req_body, "path", path, sizeof(path)) != 0) {
@@ -260,8 +335,10 @@ static void handle_sign_endpoint(int cfd, const signer_config_t *cfg, const char
     if (json_get_string(req_body, "raw_query", raw_query, sizeof(raw_query)) != 0) {
         raw_query[0] = '\0';
     }
-    if (json_get_string(req_body, "body", body_str, sizeof(body_str)) != 0) {
-        body_str[0] = '\0';
+    /* The decoded body is never longer than its JSON form: decode in place */
+    const char *body_str = req_body;
+    if (json_get_string(req_body, "body", req_body, req_body_len + 1) != 0) {
+        req_body[0] = '\0';
     }
 
     portal_sig_t sig;
@@ -279,85 +356,652 @@ static void handle_sign_endpoint(int cfd, const signer_config_t *cfg, const char
         return;
     }
 
+    reply_sig_json(cfd, &sig);
+}
+
+/*
+ * Feed the next `len` body bytes from the connection into `h`. `left` is
+ * what the upload may still send; -2 if `len` does not fit, -1 on a read
+ * error (errno ETIMEDOUT past the deadline).
+ */
+static int stream_hash(conn_in_t *in, portal_body_hash_t *h, uint64_t len,
+                       uint64_t *left, unsigned char *buf) {
+    if (len > *left) return -2;
+    *left -= len;
+    while (len > 0) {
+        size_t want = len < SIGN_STREAM_BUF ? (size_t)len : SIGN_STREAM_BUF;
+        ssize_t r = in_read(in, buf, want);
+        if (r <= 0) return -1;
+        if (portal_body_hash_update(h, buf, (size_t)r) != 0) return -1;
+        len -= (uint64_t)r;
+    }
+    return 0;
+}
+
+/* Transfer-Encoding: chunked; extensions and trailers are skipped. */
+static int stream_hash_chunked(conn_in_t *in, portal_body_hash_t *h, uint64_t *left,
+                               unsigned char *buf) {
+    char line[MAX_LINE];
+
+    for (;;) {
+        if (read_line(in, line, sizeof(line)) <= 0) return -1;
+        if (!isxdigit((unsigned char)line[0])) return -1;
+
+        errno = 0;
+        unsigned long long n = strtoull(line, NULL, 16);
+        if (errno) return -1;
+        if (n == 0) break;
+
+        int rc = stream_hash(in, h, n, left, buf);
+        if (rc != 0) return rc;
+        if (read_line(in, line, sizeof(line)) <= 0) return -1;
+        rstrip_crlf(line);
+        if (line[0]) return -1;
+    }
+
+    for (;;) {
+        if (read_line(in, line, sizeof(line)) <= 0) return -1;
+        rstrip_crlf(line);
+        if (!line[0]) return 0;
+    }
+}
+
+/*
+ * POST /sign/raw: like /sign, but the request to sign is described by
+ * X-Sign-Method / X-Sign-Path / X-Sign-Query and the payload is the raw
+ * body (Content-Length or chunked). The body is hashed as it is read
+ * through a fixed buffer and never stored.
+ *
+ * The upload is read and hashed on a worker thread that owns the
+ * connection from then on, so the main loop keeps answering
+ * auth_request meanwhile. At most SIGN_RAW_WORKERS run at once (more
+ * get 503); each is still bounded by sign.raw_max_kb (413) and
+ * sign.raw_timeout_ms for the whole body (408).
+ */
+#define SIGN_RAW_WORKERS 4
+
+static atomic_int g_sign_raw_busy;
+
+typedef struct {
+    conn_in_t     in;
+    sign_target_t t;
+    long long     content_len;
+    int           chunked;
+    uint64_t      left;
+    int           timeout_ms;
+    char          key_file[256];
+    char          buf[];            /* in.cap bytes */
+} sign_raw_job_t;
+
+static void sign_raw_run(sign_raw_job_t *job) {
+    conn_in_t *in = &job->in;
+    int cfd = in->fd;
+
+    portal_body_hash_t *h = portal_body_hash_new();
+    if (!h) {
+        http_reply(cfd, 500, "Internal Server Error");
+        return;
+    }
+
+    if (job->timeout_ms > 0)
+        in->deadline_us = mono_us() + (uint64_t)job->timeout_ms * 1000u;
+
+    unsigned char buf[SIGN_STREAM_BUF];
+    errno = 0;
+    int rc = job->chunked ? stream_hash_chunked(in, h, &job->left, buf)
+                          : stream_hash(in, h, (uint64_t)job->content_len, &job->left, buf);
+    if (rc != 0) {
+        portal_body_hash_free(h);
+        if (rc == -2)
+            http_reply(cfd, 413, "Payload Too Large");
+        else if (errno == ETIMEDOUT)
+            http_reply(cfd, 408, "Request Timeout");
+        else
+            http_reply(cfd, 400, "Bad Request");
+        return;
+    }
+
+    portal_sig_t sig;
+    memset(&sig, 0, sizeof(sig));
+    rc = portal_sign_v1_hmac_sha256_base64_stream(job->key_file, job->t.method, job->t.path,
+                                                  job->t.query, h, &sig);
+    portal_body_hash_free(h);
+    if (rc != 0) {
+        http_reply(cfd, 500, "Internal Server Error");
+        return;
+    }
+
+    reply_sig_json(cfd, &sig);
+}
+
+static void *sign_raw_main(void *arg) {
+    sign_raw_job_t *job = (sign_raw_job_t *)arg;
+    sign_raw_run(job);
+    close(job->in.fd);
+    free(job);
+    atomic_fetch_sub(&g_sign_raw_busy, 1);
+    return NULL;
+}
+
+/* Returns 1 if a worker took the connection (it replies and closes), 0 if answered here. */
+static int handle_sign_raw_endpoint(conn_in_t *in, const signer_config_t *cfg,
+                                    const sign_target_t *t, long long content_len,
+                                    int chunked) {
+    int cfd = in->fd;
+    if (!t->method[0] || !t->path[0]) {
+        http_reply(cfd, 400, "Bad Request");
+        return 0;
+    }
+
+    uint64_t left = cfg->sign_raw_max_kb > 0 ? (uint64_t)cfg->sign_raw_max_kb * 1024u : UINT64_MAX;
+    if (!chunked && (uint64_t)content_len > left) {
+        http_reply(cfd, 413, "Payload Too Large");
+        return 0;
+    }
+
+    if (atomic_fetch_add(&g_sign_raw_busy, 1) >= SIGN_RAW_WORKERS) {
+        atomic_fetch_sub(&g_sign_raw_busy, 1);
+        http_reply_hdrs(cfd, 503, "Service Unavailable", "Retry-After: 1\r\n");
+        return 0;
+    }
+
+    /* The job keeps its own copy of whatever is already buffered */
+    sign_raw_job_t *job = (sign_raw_job_t *)malloc(sizeof(*job) + in->cap);
+    if (!job) {
+        atomic_fetch_sub(&g_sign_raw_busy, 1);
+        http_reply(cfd, 500, "Internal Server Error");
+        return 0;
+    }
+    job->in = (conn_in_t){ cfd, job->buf, in->cap, in->len - in->off, 0, 0 };
+    memcpy(job->buf, in->buf + in->off, in->len - in->off);
+    job->t = *t;
+    job->content_len = content_len;
+    job->chunked = chunked;
+    job->left = left;
+    job->timeout_ms = cfg->sign_raw_timeout_ms;
+    snprintf(job->key_file, sizeof(job->key_file), "%s", cfg->key_file);
+
+    pthread_t th;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&th, &attr, sign_raw_main, job);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        free(job);
+        atomic_fetch_sub(&g_sign_raw_busy, 1);
+        http_reply(cfd, 500, "Internal Server Error");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * POST /access authentication: a v1 signature over "POST /access" and
+ * the body, made with access.key_file (never the signing key, so /sign
+ * cannot produce one). The timestamp must be within ACCESS_SKEW_SEC and
+ * the nonce unseen among the last ACCESS_NONCES accepted requests.
+ */
+#define ACCESS_SKEW_SEC  60
+#define ACCESS_NONCES    512
+
+static struct {
+    long ts;
+    char nonce[64];
+} g_access_seen[ACCESS_NONCES];
+static int g_access_next;
+
+static int access_authorized(const signer_config_t *cfg, const portal_sig_t *sig,
+                             const char *body) {
+    if (!strcmp(cfg->access_key_file, cfg->key_file)) {
+        fprintf(stderr, "[portal-signer] access: access.key_file is the signing key, "
+                        "/access disabled\n");
+        return 0;
+    }
+    if (!sig->timestamp[0] || !sig->nonce[0] || !sig->signature[0])
+        return 0;
+
+    long ts = strtol(sig->timestamp, NULL, 10);
+    long now = (long)time(NULL);
+    if (ts < now - ACCESS_SKEW_SEC || ts > now + ACCESS_SKEW_SEC)
+        return 0;
+
+    for (int i = 0; i < ACCESS_NONCES; i++)
+        if (g_access_seen[i].ts >= now - ACCESS_SKEW_SEC &&
+            !strcmp(g_access_seen[i].nonce, sig->nonce))
+            return 0;
+
+    int rc = portal_verify_v1_hmac_sha256_base64(cfg->access_key_file, sig, "POST", "/access",
+                                                 "", (const unsigned char *)body, strlen(body));
+    if (rc == -2)
+        fprintf(stderr, "[portal-signer] access: cannot read %s\n", cfg->access_key_file);
+    if (rc != 0)
+        return 0;
+
+    g_access_seen[g_access_next].ts = ts;
+    memcpy(g_access_seen[g_access_next].nonce, sig->nonce, sizeof(sig->nonce));
+    g_access_next = (g_access_next + 1) % ACCESS_NONCES;
+    return 1;
+}
+
+/*
+ * POST /access: one operation per line, queued for the allow ipsets
+ *   grant <mac> [guest|staff] [ttl]
+ *   revoke <mac>
+ * The main loop writes queued operations in batches.
+ */
+static void handle_access_endpoint(int cfd, const signer_config_t *cfg,
+                                   const portal_sig_t *sig, char *body) {
+    if (!access_authorized(cfg, sig, body)) {
+        http_reply(cfd, 401, "Unauthorized");
+        return;
+    }
+    if (!ipsetnl_enabled()) {
+        http_reply(cfd, 503, "Service Unavailable");
+        return;
+    }
+
+    int accepted = 0, rejected = 0;
+    char *save = NULL;
+    for (char *ln = strtok_r(body, "\n", &save); ln; ln = strtok_r(NULL, "\n", &save)) {
+        char op[16], mac[32], role_s[16] = "guest";
+        unsigned int ttl = 0;
+        int f = sscanf(ln, "%15s %31s %15s %u", op, mac, role_s, &ttl);
+        if (f < 1) continue;            /* blank line */
+
+        ipsetnl_role_t role;
+        int rc = -1;
+        if (f >= 2 && !strcmp(op, "grant") && ipsetnl_role_parse(role_s, &role) == 0)
+            rc = ipsetnl_grant(mac, role, ttl);
+        else if (f == 2 && !strcmp(op, "revoke"))
+            rc = ipsetnl_revoke(mac);
+
+        if (rc == 0) accepted++;
+        else rejected++;
+    }
+
+    char resp[96];
+    snprintf(resp, sizeof(resp), "{\"accepted\":%d,\"rejected\":%d}", accepted, rejected);
+    http_reply_json(cfd, (rejected && !accepted) ? 400 : 200, resp);
+}
+
+/* Verify-path request state, kept while the controller is asked */
+typedef struct {
+    int              cfd;
+    uint64_t         t_start;
+    uint64_t         t_ctrl;
+    int              have_rl_key;
+    char             rl_key[64];
+    portal_client_t  hdr;           /* client headers as received (capture) */
+    char             host[256];     /* X-Original-Host as received (capture) */
+    portal_client_t  cli;
+    declog_record_t  rec;
+} pending_verify_t;
+
+/* Per-connection state, one MEMPOOL_CONN block; parked slots stay taken */
+typedef struct {
+    pending_verify_t pv;
+    controller_req_t req;
+} conn_slot_t;
+
+/*
+ * Verify-path response heads, one per verdict: status line plus the
+ * decision headers nginx captures (portal-auth.conf maps 200 = allow,
+ * 401 / 403 = deny). Built at compile time; only the signature and
+ * client context headers are formatted per request.
+ */
+#define VERDICT_HEAD_STR(code, reason, signer, auth) \
+    "HTTP/1.1 " #code " " reason "\r\n"              \
+    "X-Portal-Signer: " signer "\r\n"                \
+    "X-Portal-Auth: " auth "\r\n"
+#define VERDICT_HEAD(code, reason, signer, auth) \
+    { code, VERDICT_HEAD_STR(code, reason, signer, auth), \
+      sizeof(VERDICT_HEAD_STR(code, reason, signer, auth)) - 1 }
+
+static const struct {
+    int         code;
+    const char *head;
+    size_t      len;
+} g_verdict_head[] = {
+    [DECLOG_VERDICT_ALLOW]   = VERDICT_HEAD(200, "OK",                    "ok",    "allow"),
+    [DECLOG_VERDICT_DENY]    = VERDICT_HEAD(401, "Unauthorized",          "ok",    "deny"),
+    [DECLOG_VERDICT_LIMITED] = VERDICT_HEAD(403, "Forbidden",             "ok",    "deny"),
+    [DECLOG_VERDICT_ERROR]   = VERDICT_HEAD(500, "Internal Server Error", "error", "error"),
+};
+
+static const char VERDICT_TAIL[] = "Content-Length: 0\r\n\r\n";
+
+/*
+ * Send the verify-path answer in one write: verdict head, the v1
+ * signature of the original request (if it was signed) and the client
+ * context; then log and capture it.
+ */
+static void reply_verdict(conn_slot_t *slot, declog_verdict_t verdict, declog_source_t source) {
+    pending_verify_t *pv = &slot->pv;
+    const portal_sig_t *sig = &slot->req.sig;
+    int code = g_verdict_head[verdict].code;
+
+    char var[640];
+    size_t off = 0;
+    if (sig->signature[0]) {
+        int w = snprintf(var, sizeof(var),
+            "X-Portal-Kid: v1\r\n"
+            "X-Portal-Timestamp: %s\r\n"
+            "X-Portal-Nonce: %s\r\n"
+            "X-Portal-Signature: %s\r\n",
+            sig->timestamp, sig->nonce, sig->signature);
+        if (w > 0) off = (size_t)w;
+    }
+    format_ctx_headers(&pv->cli, var + off, sizeof(var) - off);
+    off += strlen(var + off);
+
+    struct iovec iov[3] = {
+        { (void *)g_verdict_head[verdict].head, g_verdict_head[verdict].len },
+        { var, off },
+        { (void *)VERDICT_TAIL, sizeof(VERDICT_TAIL) - 1 },
+    };
+    g_io->send(pv->cfd, iov, 3);
+
+    uint32_t total_us = (uint32_t)(mono_us() - pv->t_start);
+    uint32_t ctrl_us = source == DECLOG_SRC_CONTROLLER ? pv->rec.ctrl_us : 0;
+
+    if (capture_enabled())
+        capture_push(pv->t_start, slot->req.method, slot->req.uri, pv->host, &pv->hdr,
+                     code, verdict, source, ctrl_us, total_us);
+
+    if (!declog_enabled()) return;
+    pv->rec.status = (uint16_t)code;
+    pv->rec.verdict = (uint8_t)verdict;
+    pv->rec.source = (uint8_t)source;
+    pv->rec.total_us = total_us;
+    (void)declog_push(&pv->rec);
+}
+
+/* --------------------------------------------------
+ * Memory budget (mem.budget_kb)
+ *
+ * Connection state and request bodies come from mempool; when either is
+ * exhausted the request is refused with a fixed 503 instead of growing.
+ * -------------------------------------------------- */
+#define BUSY_REPLY "HTTP/1.1 503 Service Unavailable\r\n" \
+                   "Retry-After: 1\r\n"                    \
+                   "Content-Length: 0\r\n"                 \
+                   "\r\n"
+
+/* GET /status: pool usage and process RSS */
+static void handle_status_endpoint(int cfd) {
+    mempool_stats_t st;
+    mempool_stats(&st);
+
     char resp[512];
     snprintf(resp, sizeof(resp),
         "{"
-          "\"kid\":\"%s\","
-          "\"timestamp\":\"%s\","
-          "\"nonce\":\"%s\","
-          "\"signature\":\"%s\""
+          "\"mem\":{"
+            "\"budget\":%zu,"
+            "\"reserved\":%zu,"
+            "\"in_use\":%zu,"
+            "\"peak\":%zu,"
+            "\"rss_kb\":%ld,"
+            "\"conn\":{\"blocks\":%u,\"used\":%u,\"rejected\":%lu},"
+            "\"body\":{\"blocks\":%u,\"used\":%u,\"rejected\":%lu}"
+          "}"
         "}",
-        "v1",
-        sig.timestamp,
-        sig.nonce,
-        sig.signature
-    );
+        st.budget, st.reserved, st.in_use, st.peak, mempool_rss_kb(),
+        st.blocks[MEMPOOL_CONN], st.used[MEMPOOL_CONN], st.rejected[MEMPOOL_CONN],
+        st.blocks[MEMPOOL_BODY], st.used[MEMPOOL_BODY], st.rejected[MEMPOOL_BODY]);
 
     http_reply_json(cfd, 200, resp);
 }
 
-void portal_signer_handle_client(int cfd, const signer_config_t *cfg) {
+/* --------------------------------------------------
+ * Controller micro-batching (batch.*)
+ *
+ * Controller-bound verifies are parked (connection kept open) while a
+ * batch window is open, then sent as one POST and answered together.
+ * The window follows the arrival rate: it is the expected time to fill
+ * batch.max items, capped at batch.window_us, and no batch is opened
+ * when fewer than one further arrival is expected within the cap.
+ * -------------------------------------------------- */
+#define BATCH_MAX_ITEMS     256
+#define BATCH_PAUSE_US      (60u * 1000000u)
+
+static conn_slot_t            *g_batch_slot[BATCH_MAX_ITEMS];
+static const controller_req_t *g_batch_req[BATCH_MAX_ITEMS];
+static int                     g_batch_allow[BATCH_MAX_ITEMS];
+static int                     g_batch_n;
+static uint64_t          g_batch_deadline_us;
+static uint64_t          g_batch_pause_until_us;
+static uint64_t          g_last_arrival_us;
+static int64_t           g_gap_ewma_us = 1000000;
+
+static int batch_limit(const signer_config_t *cfg) {
+    int n = cfg->batch_max;
+    if (n < 2) n = 2;
+    if (n > BATCH_MAX_ITEMS) n = BATCH_MAX_ITEMS;
+    int fit = controller_batch_capacity();
+    if (fit >= 2 && n > fit) n = fit;
+    return n;
+}
+
+/* Cache the controller's answer, reply and log; allow < 0 = no answer. */
+static void finish_verify(const signer_config_t *cfg, conn_slot_t *slot, int allow) {
+    pending_verify_t *pv = &slot->pv;
+    pv->rec.ctrl_us = (uint32_t)(mono_us() - pv->t_ctrl);
+
+    if (allow < 0) {
+        reply_verdict(slot, DECLOG_VERDICT_ERROR, DECLOG_SRC_CONTROLLER);
+        return;
+    }
+
+    if (pv->have_rl_key) {
+        ratelimit_set_verdict(pv->rl_key,
+                              allow ? RL_VERDICT_ALLOW : RL_VERDICT_DENY,
+                              (unsigned int)cfg->ratelimit_verdict_ttl);
+    }
+
+    if (allow) {
+        reply_verdict(slot, DECLOG_VERDICT_ALLOW, DECLOG_SRC_CONTROLLER);
+    } else {
+        reply_verdict(slot, DECLOG_VERDICT_DENY, DECLOG_SRC_CONTROLLER);
+    }
+}
+
+/* Returns 1 if the request joined a batch (connection and slot now owned here). */
+static int batch_park(const signer_config_t *cfg, conn_slot_t *slot) {
+    uint64_t now = slot->pv.t_ctrl;
+    int64_t gap = g_last_arrival_us ? (int64_t)(now - g_last_arrival_us) : 1000000;
+    if (gap > 1000000) gap = 1000000;
+    g_last_arrival_us = now;
+    g_gap_ewma_us += (gap - g_gap_ewma_us) / 8;
+
+    if (!cfg->batch_enable || now < g_batch_pause_until_us)
+        return 0;
+
+    int limit = batch_limit(cfg);
+    if (g_batch_n == 0) {
+        int64_t cap_us = cfg->batch_window_us > 0 ? cfg->batch_window_us : 0;
+        if (g_gap_ewma_us >= cap_us)
+            return 0;                   /* too quiet: nothing to batch with */
+
+        int64_t window = g_gap_ewma_us * (limit - 1);
+        if (window > cap_us) window = cap_us;
+        g_batch_deadline_us = now + (uint64_t)window;
+    }
+
+    g_batch_slot[g_batch_n] = slot;
+    g_batch_req[g_batch_n] = &slot->req;
+    g_batch_n++;
+
+    if (g_batch_n >= limit)
+        portal_signer_batch_flush(cfg, 1);
+    return 1;
+}
+
+int portal_signer_batch_timeout(void) {
+    if (!g_batch_n) return -1;
+    uint64_t now = mono_us();
+    if (now >= g_batch_deadline_us) return 0;
+    return (int)((g_batch_deadline_us - now + 999) / 1000);
+}
+
+void portal_signer_batch_flush(const signer_config_t *cfg, int force) {
+    if (!g_batch_n) return;
+    if (!force && mono_us() < g_batch_deadline_us) return;
+
+    int n = g_batch_n;
+    g_batch_n = 0;
+    g_batch_deadline_us = 0;
+
+    for (int i = 0; i < n; i++)
+        g_batch_allow[i] = -1;
+
+    int rc = n > 1 ? controller_verify_batch(cfg, g_batch_req, n, g_batch_allow) : -3;
+    if (rc == -2) {
+        fprintf(stderr, "[portal-signer] batch: controller has no %s, "
+                        "batching paused for 60s\n", cfg->batch_path);
+        g_batch_pause_until_us = mono_us() + BATCH_PAUSE_US;
+    }
+
+    /*
+     * Items without a batch verdict fall back to single verifies, unless
+     * the call failed as a whole: retrying n items one by one against a
+     * dead controller would hold the loop for n x controller.timeout_ms.
+     */
+    for (int i = 0; i < n; i++) {
+        conn_slot_t *slot = g_batch_slot[i];
+        int allow = g_batch_allow[i];
+        if (allow < 0 && rc != -1) {
+            const controller_req_t *r = &slot->req;
+            allow = controller_verify(cfg, r->method, r->uri, &r->sig) == 0;
+        }
+        finish_verify(cfg, slot, allow);
+        portal_signer_close(slot->pv.cfd);
+        mempool_put(MEMPOOL_CONN, slot);
+    }
+}
+
+/* v1 signature over the original request (empty body) into slot->req.sig. */
+static int sign_request(const signer_config_t *cfg, conn_slot_t *slot) {
+    controller_req_t *req = &slot->req;
+    char path[512], query[512];
+    split_uri(req->uri, path, sizeof(path), query, sizeof(query));
+
+    uint64_t t_sign = mono_us();
+    int rc = portal_sign_v1_hmac_sha256_base64(
+            cfg->key_file,
+            req->method,
+            path,
+            query,
+            (const unsigned char *)"",
+            0,
+            &req->sig);
+    slot->pv.rec.sign_us = (uint32_t)(mono_us() - t_sign);
+    if (rc != 0)
+        memset(&req->sig, 0, sizeof(req->sig));
+    return rc;
+}
+
+static int handle_request(conn_in_t *in, const signer_config_t *cfg, conn_slot_t *slot) {
+    int cfd = in->fd;
     char line[MAX_LINE];
+    uint64_t t_start = mono_us();
 
     /* ---- Read request line ---- */
-    ssize_t n = read_line(cfd, line, sizeof(line));
-    if (n <= 0) return;
+    ssize_t n = read_line(in, line, sizeof(line));
+    if (n <= 0) return 0;
     rstrip_crlf(line);
 
     char req_method[16] = {0};
     char req_path[512] = {0};
     if (parse_request_line(line, req_method, req_path) != 0) {
         http_reply(cfd, 400, "Bad Request");
-        return;
+        return 0;
     }
 
     /* ---- Read headers ---- */
     char orig_method[64] = {0};
     char orig_uri[512] = {0};
-    int content_len = 0;
+    char orig_host[256] = {0};
+    char upstream[32] = {0};
+    long long content_len = 0;
+    int chunked = 0;
+    sign_target_t st;
+    portal_client_t cli;
+    portal_sig_t peer_sig;
+    memset(&st, 0, sizeof(st));
+    memset(&cli, 0, sizeof(cli));
+    memset(&peer_sig, 0, sizeof(peer_sig));
 
     while (1) {
-        n = read_line(cfd, line, sizeof(line));
-        if (n < 0) return;
+        n = read_line(in, line, sizeof(line));
+        if (n < 0) return 0;
         if (n == 0) break;
         rstrip_crlf(line);
         if (line[0] == '\0') break; /* end of headers */
 
-        if (strncasecmp(line, "X-Original-Method:", 18) == 0) {
-            const char *v = line + 18;
-            while (*v == ' ' || *v == '\t') v++;
-            snprintf(orig_method, sizeof(orig_method), "%s", v);
-        } else if (strncasecmp(line, "X-Original-URI:", 15) == 0) {
-            const char *v = line + 15;
-            while (*v == ' ' || *v == '\t') v++;
-            snprintf(orig_uri, sizeof(orig_uri), "%s", v);
-        } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
-            const char *v = line + 15;
-            while (*v == ' ' || *v == '\t') v++;
-            (void)header_get_int(v, &content_len);
+        const char *v;
+        if ((v = header_value(line, "X-Original-Method:")) != NULL) {
+            header_copy(orig_method, sizeof(orig_method), v);
+        } else if ((v = header_value(line, "X-Original-URI:")) != NULL) {
+            header_copy(orig_uri, sizeof(orig_uri), v);
+        } else if ((v = header_value(line, "X-Original-Host:")) != NULL) {
+            header_copy(orig_host, sizeof(orig_host), v);
+        } else if ((v = header_value(line, "X-Portal-Upstream:")) != NULL) {
+            header_copy(upstream, sizeof(upstream), v);
+        } else if ((v = header_value(line, "X-Client-IP:")) != NULL) {
+            header_copy(cli.ip, sizeof(cli.ip), v);
+        } else if ((v = header_value(line, "X-Client-MAC:")) != NULL) {
+            header_copy(cli.mac, sizeof(cli.mac), v);
+        } else if ((v = header_value(line, "X-Client-SSID:")) != NULL) {
+            header_copy(cli.ssid, sizeof(cli.ssid), v);
+        } else if ((v = header_value(line, "X-Client-Radio-ID:")) != NULL) {
+            header_copy(cli.radio, sizeof(cli.radio), v);
+        } else if ((v = header_value(line, "X-Portal-VLAN-ID:")) != NULL) {
+            (void)header_get_int(v, &cli.vlan_id);
+        } else if ((v = header_value(line, "X-Sign-Method:")) != NULL) {
+            header_copy(st.method, sizeof(st.method), v);
+        } else if ((v = header_value(line, "X-Sign-Path:")) != NULL) {
+            header_copy(st.path, sizeof(st.path), v);
+        } else if ((v = header_value(line, "X-Sign-Query:")) != NULL) {
+            header_copy(st.query, sizeof(st.query), v);
+        } else if ((v = header_value(line, "X-Portal-Timestamp:")) != NULL) {
+            header_copy(peer_sig.timestamp, sizeof(peer_sig.timestamp), v);
+        } else if ((v = header_value(line, "X-Portal-Nonce:")) != NULL) {
+            header_copy(peer_sig.nonce, sizeof(peer_sig.nonce), v);
+        } else if ((v = header_value(line, "X-Portal-Signature:")) != NULL) {
+            header_copy(peer_sig.signature, sizeof(peer_sig.signature), v);
+        } else if ((v = header_value(line, "Content-Length:")) != NULL) {
+            content_len = strtoll(v, NULL, 10);
             if (content_len < 0) content_len = 0;
-            if (content_len > MAX_BODY) {
-                http_reply(cfd, 413, "Payload Too Large");
-                return;
-            }
+        } else if ((v = header_value(line, "Transfer-Encoding:")) != NULL) {
+            chunked = strcasecmp(v, "chunked") == 0;
         }
     }
 
+    /* ---- Route: /sign/raw (streamed, sign.raw_max_kb instead of MAX_BODY) ---- */
+    if (strcmp(req_method, "POST") == 0 && strcmp(req_path, "/sign/raw") == 0) {
+        return handle_sign_raw_endpoint(in, cfg, &st, content_len, chunked) ? REQ_DETACHED : 0;
+    }
+
+    if (content_len > MAX_BODY) {
+        http_reply(cfd, 413, "Payload Too Large");
+        return 0;
+    }
+
     /* ---- Read body if any ---- */
     char *body = NULL;
     if (content_len > 0) {
-        body = (char *)malloc((size_t)content_len + 1);
+        body = (char *)mempool_get(MEMPOOL_BODY);
         if (!body) {
-            http_reply(cfd, 500, "Internal Server Error");
-            return;
+            conn_send(cfd, BUSY_REPLY, sizeof(BUSY_REPLY) - 1);
+            return 0;
         }
         size_t got = 0;
         while (got < (size_t)content_len) {
-            ssize_t r = read(cfd, body + got, (size_t)content_len - got);
+            ssize_t r = in_read(in, body + got, (size_t)content_len - got);
             if (r < 0) {
-                if (errno == EINTR) continue;
-                free(body);
-                return;
+                mempool_put(MEMPOOL_BODY, body);
+                return 0;
             }
             if (r == 0) break;
             got += (size_t)r;
@@ -369,46 +1013,148 @@ void portal_signer_handle_client(int cfd, const signer_config_t *cfg) {
     if (strcmp(req_method, "POST") == 0 && strcmp(req_path, "/sign") == 0) {
         if (!body) {
             http_reply(cfd, 400, "Bad Request");
-            return;
+            return 0;
         }
         handle_sign_endpoint(cfd, cfg, body, strlen(body));
-        free(body);
-        return;
+        mempool_put(MEMPOOL_BODY, body);
+        return 0;
     }
 
-    free(body);
+    /* ---- Route: /access ---- */
+    if (strcmp(req_method, "POST") == 0 && strcmp(req_path, "/access") == 0) {
+        if (!body) {
+            http_reply(cfd, 400, "Bad Request");
+            return 0;
+        }
+        handle_access_endpoint(cfd, cfg, &peer_sig, body);
+        mempool_put(MEMPOOL_BODY, body);
+        return 0;
+    }
+
+    mempool_put(MEMPOOL_BODY, body);
+
+    /* ---- Route: /status ---- */
+    if (strcmp(req_method, "GET") == 0 && strcmp(req_path, "/status") == 0) {
+        handle_status_endpoint(cfd);
+        return 0;
+    }
 
     /* ---- Default: nginx auth_request verify path (legacy behavior) ----
-     * Uses X-Original-Method and X-Original-URI provided by nginx.
+     * Uses X-Original-Method and X-Original-URI provided by nginx;
+     * X-Original-Host is only recorded (capture), never trusted.
      */
     if (orig_method[0] == '\0' || orig_uri[0] == '\0') {
         http_reply(cfd, 400, "Bad Request");
-        return;
+        return 0;
     }
 
-    /* Build v1 signature over original request with empty body */
-    char path[512], query[512];
-    split_uri(orig_uri, path, sizeof(path), query, sizeof(query));
+    pending_verify_t *pv = &slot->pv;
+    controller_req_t *req = &slot->req;
+    pv->cfd = cfd;
+    pv->t_start = t_start;
+    pv->hdr = cli;
+    memcpy(pv->host, orig_host, sizeof(pv->host));
+    snprintf(req->method, sizeof(req->method), "%s", orig_method);
+    snprintf(req->uri, sizeof(req->uri), "%s", orig_uri);
 
-    portal_sig_t sig;
-    memset(&sig, 0, sizeof(sig));
+    /* Fill whatever nginx could not provide from the live context table */
+    clientctx_resolve(&cli);
+    pv->cli = cli;
 
-    if (portal_sign_v1_hmac_sha256_base64(
-            cfg->key_file,
-            orig_method,
-            path,
-            query,
-            (const unsigned char *)"",
-            0,
-            &sig) != 0) {
-        http_reply(cfd, 500, "Internal Server Error");
-        return;
+    memset(&pv->rec, 0, sizeof(pv->rec));
+    if (declog_enabled()) {
+        declog_fill(&pv->rec, &cli, orig_method, orig_uri);
+        pv->rec.parse_us = (uint32_t)(mono_us() - t_start);
     }
 
-    /* Verify with controller */
-    if (controller_verify(cfg, orig_method, orig_uri, &sig) == 0) {
-        http_reply(cfd, 204, "No Content");   /* allow */
-    } else {
-        http_reply(cfd, 401, "Unauthorized"); /* deny */
+    pv->have_rl_key = ratelimit_client_key(&cli, pv->rl_key, sizeof(pv->rl_key)) == 0;
+
+    memset(&req->sig, 0, sizeof(req->sig));
+
+    /* OS connectivity probe: answer from local allow state, no signing */
+    if (pv->have_rl_key && probe_match(orig_uri) &&
+        ratelimit_get_verdict(pv->rl_key) == RL_VERDICT_ALLOW) {
+        reply_verdict(slot, DECLOG_VERDICT_ALLOW, DECLOG_SRC_PROBE);
+        return 0;
     }
+
+    /*
+     * Walled garden: only for requests nginx proxies to portal_server, so
+     * a forged Host reaches nothing but the portal. Still signed since it
+     * goes upstream.
+     */
+    if (!strcmp(upstream, "portal_server") && bypass_match(orig_host, orig_uri)) {
+        if (sign_request(cfg, slot) != 0)
+            reply_verdict(slot, DECLOG_VERDICT_ERROR, DECLOG_SRC_LOCAL);
+        else
+            reply_verdict(slot, DECLOG_VERDICT_ALLOW, DECLOG_SRC_BYPASS);
+        return 0;
+    }
+
+    /* Per-client token bucket: over-limit clients get a local answer */
+    if (pv->have_rl_key && cfg->ratelimit_enable) {
+        int rate, burst;
+        rl_verdict_t cached;
+        ratelimit_resolve(cfg, &cli, &rate, &burst);
+        if (!ratelimit_take(pv->rl_key, rate, burst, &cached)) {
+            /* A cached allow is forwarded upstream, so it carries a signature */
+            if (cached != RL_VERDICT_ALLOW)
+                reply_verdict(slot, DECLOG_VERDICT_LIMITED, DECLOG_SRC_RATELIMIT);
+            else if (sign_request(cfg, slot) != 0)
+                reply_verdict(slot, DECLOG_VERDICT_ERROR, DECLOG_SRC_LOCAL);
+            else
+                reply_verdict(slot, DECLOG_VERDICT_ALLOW, DECLOG_SRC_RATELIMIT);
+            return 0;
+        }
+    }
+
+    /* Build v1 signature over original request with empty body */
+    if (sign_request(cfg, slot) != 0) {
+        reply_verdict(slot, DECLOG_VERDICT_ERROR, DECLOG_SRC_LOCAL);
+        return 0;
+    }
+    pv->t_ctrl = mono_us();
+
+    /* Verify with controller: batched with other clients, or directly */
+    if (batch_park(cfg, slot))
+        return 1;
+
+    int allow = controller_verify(cfg, req->method, req->uri, &req->sig) == 0;
+    finish_verify(cfg, slot, allow);
+    return 0;
+}
+
+int portal_signer_init(const signer_config_t *cfg) {
+    size_t budget = cfg->mem_budget_kb > 0 ? (size_t)cfg->mem_budget_kb * 1024u : 0;
+    return mempool_init(budget, sizeof(conn_slot_t), MAX_BODY + 1);
+}
+
+void portal_signer_shutdown(void) {
+    mempool_shutdown();
+}
+
+static int serve(conn_in_t *in, const signer_config_t *cfg) {
+    /* Admission: a connection is served only if its state fits the budget */
+    conn_slot_t *slot = (conn_slot_t *)mempool_get(MEMPOOL_CONN);
+    if (!slot) {
+        conn_send(in->fd, BUSY_REPLY, sizeof(BUSY_REPLY) - 1);
+        return 0;
+    }
+
+    int parked = handle_request(in, cfg, slot);
+    if (parked != 1)
+        mempool_put(MEMPOOL_CONN, slot);
+    return parked != 0;
+}
+
+int portal_signer_handle_client(int cfd, const signer_config_t *cfg) {
+    char buf[SIGNER_IN_BUF];
+    conn_in_t in = { cfd, buf, sizeof(buf), 0, 0, 0 };
+    return serve(&in, cfg);
+}
+
+int portal_signer_handle_data(int cfd, const signer_config_t *cfg,
+                              char *buf, size_t len, size_t cap) {
+    conn_in_t in = { cfd, buf, cap, len, 0, 0 };
+    return serve(&in, cfg);
 }
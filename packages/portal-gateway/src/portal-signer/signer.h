@@ -1,8 +1,74 @@
 #pragma once
 
 #include <stddef.h>
+#include <sys/uio.h>
 #include "config.h"
 #include "crypto_hmac.h"
 
-/* Handle one incoming HTTP connection (TCP). */
-void portal_signer_handle_client(int cfd, const signer_config_t *cfg);
+/*
+ * Client context forwarded by nginx on the auth_request subrequest
+ * (see /__portal_auth in portal-gateway.conf).
+ *
+ * Empty strings / 0 mean "not provided".
+ */
+typedef struct {
+    char ip[64];        /* X-Client-IP */
+    char mac[32];       /* X-Client-MAC */
+    char ssid[64];      /* X-Client-SSID */
+    char radio[32];     /* X-Client-Radio-ID */
+    int  vlan_id;       /* X-Portal-VLAN-ID */
+} portal_client_t;
+
+/*
+ * Size the per-request buffer pool from mem.budget_kb (once at startup,
+ * not reloaded). Returns 0 or -1; on failure requests use malloc().
+ */
+int  portal_signer_init(const signer_config_t *cfg);
+void portal_signer_shutdown(void);
+
+/*
+ * Handle one incoming HTTP connection (TCP).
+ *
+ * On the verify path the answer is 200 (allow), 401 (deny), 403 (rate
+ * limited) or 500, with response headers for nginx auth_request_set:
+ *   X-Portal-Signer / X-Portal-Auth        decision (ok|error, allow|deny|error)
+ *   X-Portal-Kid / -Timestamp / -Nonce /
+ *   X-Portal-Signature                     v1 signature of the original request
+ *   X-Client-MAC / -SSID / -Radio-ID,
+ *   X-Portal-VLAN-ID                       resolved client context
+ *
+ * Connection state and the request body are taken from the buffer pool;
+ * if it is exhausted the request gets 503 with Retry-After.
+ *
+ * Returns 1 if the connection was parked in a controller batch (it is
+ * answered and closed by portal_signer_batch_flush) or handed to a
+ * POST /sign/raw worker thread (which answers and closes it), 0 if the
+ * caller should close it.
+ */
+int  portal_signer_handle_client(int cfd, const signer_config_t *cfg);
+
+/*
+ * Same, for a connection whose first `len` bytes the caller has already
+ * received into `buf` (capacity `cap`, reused for further reads).
+ */
+int  portal_signer_handle_data(int cfd, const signer_config_t *cfg,
+                               char *buf, size_t len, size_t cap);
+
+/*
+ * Reply transport. Replies and closes of client connections go through
+ * these; the default is writev() / close(). The io_uring backend queues
+ * them as linked send + close instead.
+ */
+typedef struct {
+    void (*send)(int fd, const struct iovec *iov, int iovcnt);
+    void (*close)(int fd);
+} portal_signer_io_t;
+
+void portal_signer_set_io(const portal_signer_io_t *io);   /* NULL = default */
+void portal_signer_close(int fd);
+
+/* Milliseconds until the open controller batch is due, -1 if none. */
+int  portal_signer_batch_timeout(void);
+
+/* Send the open batch when due (or now if `force`) and answer its requests. */
+void portal_signer_batch_flush(const signer_config_t *cfg, int force);
@@ -0,0 +1,479 @@
+#include "uring.h"
+#include "signer.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+/* IORING_ACCEPT_MULTISHOT came with provided buffer rings (5.19 headers) */
+#if defined(__NR_io_uring_setup) && defined(IORING_ACCEPT_MULTISHOT)
+
+#define URING_BGID          1
+#define URING_BUFS          64          /* provided receive buffers, power of 2 */
+#define URING_RECV_BUF      4096
+#define URING_SENDS         64
+#define URING_SEND_BUF      2048
+#define URING_WATCHES       4
+
+enum {
+    OP_ACCEPT = 1,
+    OP_RECV,
+    OP_SEND,
+    OP_CLOSE,
+    OP_POLL,
+};
+
+#define UD(op, idx, fd)     (((uint64_t)(op) << 56) | ((uint64_t)(idx) << 32) | (uint32_t)(fd))
+#define UD_OP(ud)           ((int)((ud) >> 56))
+#define UD_IDX(ud)          ((int)(((ud) >> 32) & 0xffffff))
+#define UD_FD(ud)           ((int)(uint32_t)(ud))
+
+typedef struct {
+    int       fd;
+    void (*fn)(void);
+} uring_watch_t;
+
+static int                    g_ring = -1;
+static int                    g_listen = -1;
+
+static void                  *g_ring_map;
+static size_t                 g_ring_sz;
+static struct io_uring_sqe   *g_sqes;
+static size_t                 g_sqes_sz;
+
+static unsigned              *g_sq_head;
+static unsigned              *g_sq_ktail;
+static unsigned              *g_sq_array;
+static unsigned               g_sq_mask;
+static unsigned               g_sq_entries;
+static unsigned               g_sq_tail;        /* local, published on submit */
+static unsigned               g_sq_published;
+
+static unsigned              *g_cq_head;
+static unsigned              *g_cq_tail;
+static unsigned               g_cq_mask;
+static struct io_uring_cqe   *g_cqes;
+
+static struct io_uring_buf_ring *g_br;
+static size_t                 g_br_sz;
+static uint16_t               g_br_tail;
+static char                  *g_bufs;
+
+static char                  *g_send_buf;
+static int                    g_send_free[URING_SENDS];
+static int                    g_send_nfree;
+
+static uring_watch_t          g_watch[URING_WATCHES];
+static int                    g_nwatch;
+
+/* Last queued send, not yet submitted: a close of the same fd links to it */
+static struct io_uring_sqe   *g_link_sqe;
+static int                    g_link_fd = -1;
+
+/* --------------------------------------------------
+ * Helpers
+ * -------------------------------------------------- */
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+                     const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, g_ring, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+static int sys_register(unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, g_ring, op, arg, nr);
+}
+
+static unsigned sq_pending(void) {
+    return g_sq_tail - g_sq_published;
+}
+
+static void sq_publish(void) {
+    __atomic_store_n(g_sq_ktail, g_sq_tail, __ATOMIC_RELEASE);
+    g_sq_published = g_sq_tail;
+    g_link_sqe = NULL;
+}
+
+static int sq_submit(void) {
+    unsigned n = sq_pending();
+    if (!n) return 0;
+    sq_publish();
+    return sys_enter(n, 0, 0, NULL, 0);
+}
+
+static struct io_uring_sqe *sqe_get(void) {
+    unsigned head = __atomic_load_n(g_sq_head, __ATOMIC_ACQUIRE);
+    if (g_sq_tail - head >= g_sq_entries) {
+        /* Queue full: hand what we have to the kernel */
+        if (sq_submit() < 0) return NULL;
+        head = __atomic_load_n(g_sq_head, __ATOMIC_ACQUIRE);
+        if (g_sq_tail - head >= g_sq_entries) return NULL;
+    }
+
+    unsigned idx = g_sq_tail & g_sq_mask;
+    struct io_uring_sqe *sqe = &g_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    g_sq_array[idx] = idx;
+    g_sq_tail++;
+    return sqe;
+}
+
+static void buf_recycle(unsigned bid) {
+    struct io_uring_buf *b = &g_br->bufs[g_br_tail & (URING_BUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(g_bufs + (size_t)bid * URING_RECV_BUF);
+    b->len = URING_RECV_BUF;
+    b->bid = (uint16_t)bid;
+    g_br_tail++;
+    __atomic_store_n(&g_br->tail, g_br_tail, __ATOMIC_RELEASE);
+}
+
+static void queue_accept(void) {
+    struct io_uring_sqe *sqe = sqe_get();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = g_listen;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = UD(OP_ACCEPT, 0, g_listen);
+}
+
+static int queue_recv(int fd) {
+    struct io_uring_sqe *sqe = sqe_get();
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = URING_RECV_BUF;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = UD(OP_RECV, 0, fd);
+    return 0;
+}
+
+static void queue_poll(int i) {
+    struct io_uring_sqe *sqe = sqe_get();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = g_watch[i].fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = UD(OP_POLL, i, g_watch[i].fd);
+}
+
+/* --------------------------------------------------
+ * Reply transport
+ * -------------------------------------------------- */
+static void io_send(int fd, const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+
+    /* The data must outlive the call; oversized or overflow replies go out directly */
+    if (!g_send_nfree || total > URING_SEND_BUF) {
+        (void)writev(fd, iov, iovcnt);
+        return;
+    }
+
+    int slot = g_send_free[g_send_nfree - 1];
+    struct io_uring_sqe *sqe = sqe_get();
+    if (!sqe) {
+        (void)writev(fd, iov, iovcnt);
+        return;
+    }
+    g_send_nfree--;
+
+    char *buf = g_send_buf + (size_t)slot * URING_SEND_BUF;
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)total;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = UD(OP_SEND, slot, fd);
+
+    g_link_sqe = sqe;
+    g_link_fd = fd;
+}
+
+static void io_close(int fd) {
+    /* Close only after the reply left: link it to the pending send */
+    if (g_link_sqe && g_link_fd == fd)
+        g_link_sqe->flags |= IOSQE_IO_LINK;
+    g_link_sqe = NULL;
+
+    struct io_uring_sqe *sqe = sqe_get();
+    if (!sqe) {
+        close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = UD(OP_CLOSE, 0, fd);
+}
+
+static const portal_signer_io_t g_uring_io = { io_send, io_close };
+
+/* --------------------------------------------------
+ * Completions
+ * -------------------------------------------------- */
+static void on_recv(const signer_config_t *cfg, int fd, const struct io_uring_cqe *cqe) {
+    if (cqe->res == -ENOBUFS) {
+        /* All receive buffers taken: read this one directly */
+        if (!portal_signer_handle_client(fd, cfg))
+            portal_signer_close(fd);
+        return;
+    }
+    if (cqe->res <= 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+        portal_signer_close(fd);
+        return;
+    }
+
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    char *buf = g_bufs + (size_t)bid * URING_RECV_BUF;
+    if (!portal_signer_handle_data(fd, cfg, buf, (size_t)cqe->res, URING_RECV_BUF))
+        portal_signer_close(fd);
+    buf_recycle(bid);
+}
+
+static void on_cqe(const signer_config_t *cfg, const struct io_uring_cqe *cqe) {
+    uint64_t ud = cqe->user_data;
+    int fd = UD_FD(ud);
+
+    switch (UD_OP(ud)) {
+    case OP_ACCEPT:
+        if (cqe->res >= 0 && queue_recv(cqe->res) != 0)
+            close(cqe->res);
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            queue_accept();
+        break;
+    case OP_RECV:
+        on_recv(cfg, fd, cqe);
+        break;
+    case OP_SEND:
+        g_send_free[g_send_nfree++] = UD_IDX(ud);
+        break;
+    case OP_CLOSE:
+        /* Cancelled with its failed send */
+        if (cqe->res == -ECANCELED)
+            close(fd);
+        break;
+    case OP_POLL: {
+        int i = UD_IDX(ud);
+        if (i < g_nwatch) {
+            if (cqe->res > 0)
+                g_watch[i].fn();
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+                queue_poll(i);
+        }
+        break;
+    }
+    }
+}
+
+/* --------------------------------------------------
+ * Public API
+ * -------------------------------------------------- */
+int uring_watch(int fd, void (*fn)(void)) {
+    if (fd < 0 || g_ring < 0) return 0;
+    if (g_nwatch >= URING_WATCHES) return -1;
+    g_watch[g_nwatch].fd = fd;
+    g_watch[g_nwatch].fn = fn;
+    queue_poll(g_nwatch++);
+    return 0;
+}
+
+int uring_wait(const signer_config_t *cfg, int timeout_ms) {
+    unsigned head = *g_cq_head;
+    unsigned tail = __atomic_load_n(g_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned n = sq_pending();
+
+    /* Nothing to submit and completions at hand (or no wait): skip the syscall */
+    if (n || (head == tail && timeout_ms > 0)) {
+        struct __kernel_timespec ts = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_nsec = (long long)(timeout_ms % 1000) * 1000000,
+        };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        sq_publish();
+        unsigned want = (head == tail && timeout_ms > 0) ? 1 : 0;
+        int rc = sys_enter(n, want, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                           &arg, sizeof(arg));
+        if (rc < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+            return -1;
+        tail = __atomic_load_n(g_cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    int handled = 0;
+    while (head != tail) {
+        struct io_uring_cqe cqe = g_cqes[head & g_cq_mask];
+        head++;
+        __atomic_store_n(g_cq_head, head, __ATOMIC_RELEASE);
+        on_cqe(cfg, &cqe);
+        handled++;
+        if (head == tail)
+            tail = __atomic_load_n(g_cq_tail, __ATOMIC_ACQUIRE);
+    }
+    return handled;
+}
+
+int uring_start(const signer_config_t *cfg, int listen_fd) {
+    unsigned entries = cfg->io_uring_entries > 0 ? (unsigned)cfg->io_uring_entries : 256;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    g_ring = sys_setup(entries, &p);
+    if (g_ring < 0) {
+        fprintf(stderr, "[portal-signer] io: io_uring_setup: %s\n", strerror(errno));
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        fprintf(stderr, "[portal-signer] io: io_uring too old (features 0x%x)\n", p.features);
+        uring_stop();
+        return -1;
+    }
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    g_ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    g_ring_map = mmap(NULL, g_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      g_ring, IORING_OFF_SQ_RING);
+    g_sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    g_sqes = (struct io_uring_sqe *)mmap(NULL, g_sqes_sz, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, g_ring, IORING_OFF_SQES);
+    if (g_ring_map == MAP_FAILED || g_sqes == MAP_FAILED) {
+        if (g_ring_map == MAP_FAILED) g_ring_map = NULL;
+        if (g_sqes == MAP_FAILED) g_sqes = NULL;
+        uring_stop();
+        return -1;
+    }
+
+    char *r = (char *)g_ring_map;
+    g_sq_head = (unsigned *)(r + p.sq_off.head);
+    g_sq_ktail = (unsigned *)(r + p.sq_off.tail);
+    g_sq_mask = *(unsigned *)(r + p.sq_off.ring_mask);
+    g_sq_entries = *(unsigned *)(r + p.sq_off.ring_entries);
+    g_sq_array = (unsigned *)(r + p.sq_off.array);
+    g_sq_tail = *g_sq_ktail;
+    g_sq_published = g_sq_tail;
+    g_cq_head = (unsigned *)(r + p.cq_off.head);
+    g_cq_tail = (unsigned *)(r + p.cq_off.tail);
+    g_cq_mask = *(unsigned *)(r + p.cq_off.ring_mask);
+    g_cqes = (struct io_uring_cqe *)(r + p.cq_off.cqes);
+
+    /* Provided receive buffers (5.19+); failure here means an older kernel */
+    g_br_sz = URING_BUFS * sizeof(struct io_uring_buf);
+    g_br = (struct io_uring_buf_ring *)mmap(NULL, g_br_sz, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    g_bufs = (char *)aligned_alloc(64, (size_t)URING_BUFS * URING_RECV_BUF);
+    g_send_buf = (char *)aligned_alloc(64, (size_t)URING_SENDS * URING_SEND_BUF);
+    if (g_br == MAP_FAILED || !g_bufs || !g_send_buf) {
+        if (g_br == MAP_FAILED) g_br = NULL;
+        uring_stop();
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)g_br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
+    if (sys_register(IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        fprintf(stderr, "[portal-signer] io: no provided buffer rings: %s\n", strerror(errno));
+        uring_stop();
+        return -1;
+    }
+
+    g_br_tail = 0;
+    for (unsigned i = 0; i < URING_BUFS; i++)
+        buf_recycle(i);
+    for (int i = 0; i < URING_SENDS; i++)
+        g_send_free[i] = URING_SENDS - 1 - i;
+    g_send_nfree = URING_SENDS;
+
+    g_listen = listen_fd;
+    g_nwatch = 0;
+    queue_accept();
+    portal_signer_set_io(&g_uring_io);
+
+    fprintf(stderr, "[portal-signer] io: io_uring, %u entries, %d x %d B receive buffers\n",
+            p.sq_entries, URING_BUFS, URING_RECV_BUF);
+    return 0;
+}
+
+void uring_stop(void) {
+    if (g_ring >= 0 && g_sqes) {
+        /* Let queued replies (e.g. from the final batch flush) go out */
+        struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 100000000 };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        unsigned n = sq_pending();
+        if (n) {
+            sq_publish();
+            (void)sys_enter(n, n, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                            &arg, sizeof(arg));
+        }
+    }
+
+    portal_signer_set_io(NULL);
+    if (g_ring >= 0) close(g_ring);
+    g_ring = -1;
+
+    if (g_ring_map) munmap(g_ring_map, g_ring_sz);
+    if (g_sqes) munmap(g_sqes, g_sqes_sz);
+    if (g_br) munmap(g_br, g_br_sz);
+    free(g_bufs);
+    free(g_send_buf);
+    g_ring_map = NULL;
+    g_sqes = NULL;
+    g_br = NULL;
+    g_bufs = NULL;
+    g_send_buf = NULL;
+    g_link_sqe = NULL;
+    g_nwatch = 0;
+}
+
+#else /* no io_uring in the kernel headers */
+
+int uring_start(const signer_config_t *cfg, int listen_fd) {
+    (void)cfg; (void)listen_fd;
+    fprintf(stderr, "[portal-signer] io: built without io_uring support\n");
+    return -1;
+}
+
+void uring_stop(void) {}
+
+int uring_watch(int fd, void (*fn)(void)) {
+    (void)fd; (void)fn;
+    return 0;
+}
+
+int uring_wait(const signer_config_t *cfg, int timeout_ms) {
+    (void)cfg; (void)timeout_ms;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "config.h"
+
+/*
+ * io_uring network backend (io.backend=uring).
+ *
+ * Replaces the poll()/accept()/read()/writev()/close() sequence of the
+ * main loop for client connections:
+ *   - one multishot accept on the listener
+ *   - one receive per connection into a provided buffer ring
+ *   - replies queued as send linked to close (portal_signer_io_t)
+ *   - netlink event fds as multishot polls
+ * Everything queued while handling a round of completions is submitted
+ * with the next wait, so one io_uring_enter covers all connections.
+ *
+ * Requests are still handled synchronously as they complete, and the
+ * controller connections keep their own blocking sockets.
+ *
+ * Needs Linux 5.19 (provided buffer rings, multishot accept); uses the
+ * raw syscalls, no liburing. Single-threaded (main loop only).
+ */
+
+/* Set up the ring for `listen_fd`. Returns 0, or -1 to stay on poll. */
+int  uring_start(const signer_config_t *cfg, int listen_fd);
+void uring_stop(void);
+
+/* Call `fn` whenever `fd` is readable (ignored if fd < 0). */
+int  uring_watch(int fd, void (*fn)(void));
+
+/*
+ * Submit queued work and wait up to `timeout_ms` for completions, then
+ * handle them. Returns the number handled (0 on timeout), -1 on error.
+ */
+int  uring_wait(const signer_config_t *cfg, int timeout_ms);